@@ -0,0 +1,141 @@
+#include "async_log.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <print>
+#include <thread>
+
+#include "common/mpsc_ring.hpp"
+#include "packet/formatters.hpp"
+
+namespace {
+
+constexpr size_t RingSize = 1024;
+
+struct Record {
+  enum class Kind : uint8_t { DeserializeError, Text, Client };
+
+  Kind kind;
+  DeserializeError err;
+  uint8_t length;
+  MessageType type;
+  Connection conn;
+  const char *source;
+  char text[AsyncLog::MaxTextLength];
+};
+
+// Producers push into the ring and wake the printing thread
+class Logger {
+public:
+  Logger() { thread = std::jthread(std::bind_front(&Logger::run, this)); }
+
+  ~Logger() {
+    thread.request_stop();
+    wake();
+  }
+
+  void push(const Record &record) {
+    if (!ring.push(record)) {
+      droppedRecords.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    wake();
+  }
+
+  uint64_t dropped() const {
+    return droppedRecords.load(std::memory_order_relaxed);
+  }
+
+private:
+  void wake() {
+    if (!signaled.exchange(true, std::memory_order_release)) {
+      signaled.notify_one();
+    }
+  }
+
+  void run(std::stop_token stoken) {
+    uint64_t reportedDrops = 0;
+    for (;;) {
+      signaled.wait(false, std::memory_order_acquire);
+      // Cleared before draining, a push after the drain starts sets it again
+      // and gets another round
+      signaled.exchange(false, std::memory_order_acq_rel);
+      // Drain before checking for stop so nothing queued is lost at exit
+      Record record;
+      while (ring.pop(record)) {
+        print(record);
+      }
+
+      uint64_t drops = dropped();
+      if (drops != reportedDrops) {
+        std::println("Log ring full, dropped {} record(s)",
+                     drops - reportedDrops);
+        reportedDrops = drops;
+      }
+      if (stoken.stop_requested()) {
+        return;
+      }
+    }
+  }
+
+  static void print(const Record &record) {
+    switch (record.kind) {
+    case Record::Kind::DeserializeError:
+      std::println("{} from {}:{} :: Deserialize error :: {}", record.type,
+                   record.conn.ip(), record.conn.port(), record.err);
+      break;
+    case Record::Kind::Text:
+      std::println("{}: {}", record.source,
+                   std::string_view(record.text, record.length));
+      break;
+    case Record::Kind::Client:
+      std::println("Client {}:{} {}", record.conn.ip(), record.conn.port(),
+                   record.source);
+      break;
+    }
+  }
+
+  MpscRing<Record, RingSize> ring;
+  alignas(64) std::atomic<uint64_t> droppedRecords{0};
+  std::atomic<bool> signaled{false};
+
+  std::jthread thread;
+};
+
+Logger &logger() {
+  static Logger instance;
+  return instance;
+}
+
+} // namespace
+
+void AsyncLog::deserializeError(MessageType type, DeserializeError err,
+                                const Connection &conn) {
+  Record record;
+  record.kind = Record::Kind::DeserializeError;
+  record.err = err;
+  record.type = type;
+  record.conn = conn;
+  logger().push(record);
+}
+
+void AsyncLog::text(const char *source, std::string_view text) {
+  Record record;
+  record.kind = Record::Kind::Text;
+  record.source = source;
+  record.length = static_cast<uint8_t>(std::min(text.size(), MaxTextLength));
+  std::copy_n(text.data(), record.length, record.text);
+  logger().push(record);
+}
+
+void AsyncLog::client(const char *event, const Connection &conn) {
+  Record record;
+  record.kind = Record::Kind::Client;
+  record.source = event;
+  record.conn = conn;
+  logger().push(record);
+}
+
+uint64_t AsyncLog::dropped() { return logger().dropped(); }
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "common/types.hpp"
+#include "packet/packet.hpp"
+
+// Console log for threads that must never wait on console I/O. Producers
+// copy a fixed-size binary record into a bounded lock-free MPSC ring and
+// return, a background thread formats and prints the records in order. When
+// the ring is full the record is dropped and counted instead
+class AsyncLog {
+public:
+  // Longer text is truncated
+  static constexpr size_t MaxTextLength = 96;
+
+  // A request body that failed to parse, printed through the packet
+  // formatters
+  static void deserializeError(MessageType type, DeserializeError err,
+                               const Connection &conn);
+  // Free-form text. source must be a string literal
+  static void text(const char *source, std::string_view text);
+  // Client table event, printed as "Client <ip>:<port> <event>". event must
+  // be a string literal
+  static void client(const char *event, const Connection &conn);
+
+  // Records lost to a full ring
+  static uint64_t dropped();
+};
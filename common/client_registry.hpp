@@ -0,0 +1,228 @@
+#pragma once
+
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "common/types.hpp"
+
+// Fixed-capacity client table keyed by Connection::key(). Lookups go through
+// a linear-probing open-addressing index into a pool of stable client slots,
+// and idle clients are evicted through a timer wheel, so neither lookups,
+// refreshes nor expiry allocate once the registry is constructed. Not
+// thread-safe, callers serialize access.
+template <typename Client, size_t Capacity = 1024> class ClientRegistry {
+  static_assert(std::has_single_bit(Capacity),
+                "ClientRegistry capacity must be a power of two");
+
+public:
+  using Clock = std::chrono::steady_clock;
+  // Resolution of the idle timeout
+  static constexpr auto WheelTick = std::chrono::milliseconds(250);
+
+  explicit ClientRegistry(Clock::duration timeout)
+      : timeout(timeout),
+        wheel(static_cast<size_t>(timeout / WheelTick) + 2, None),
+        nodes(Capacity), index(TableSize) {
+    freeNodes.reserve(Capacity);
+    for (size_t i = Capacity; i-- > 0;) {
+      freeNodes.push_back(static_cast<uint32_t>(i));
+    }
+    live.reserve(Capacity);
+  }
+
+  size_t size() const { return live.size(); }
+
+  Client *find(const Connection &conn) {
+    size_t slot = findSlot(conn.key());
+    return slot == None ? nullptr : &nodes[index[slot].node].client;
+  }
+
+  // Looks up the client, adding a default-constructed one if it's new, and
+  // restarts its idle timeout. Returns nullptr when the registry is full
+  std::pair<Client *, bool> touch(const Connection &conn,
+                                  Clock::time_point now) {
+    uint64_t key = conn.key();
+    size_t slot = findSlot(key);
+    bool inserted = false;
+    uint32_t n;
+    if (slot != None) {
+      n = index[slot].node;
+      unlinkTimer(n);
+    } else {
+      if (freeNodes.empty()) {
+        return {nullptr, false};
+      }
+      n = freeNodes.back();
+      freeNodes.pop_back();
+      nodes[n].client = Client{};
+      nodes[n].key = key;
+      nodes[n].livePos = static_cast<uint32_t>(live.size());
+      live.push_back(n);
+      insertSlot(key, n);
+      inserted = true;
+    }
+
+    nodes[n].lastSeen = now;
+    linkTimer(n, tickAtOrAfter(now + timeout));
+    return {&nodes[n].client, inserted};
+  }
+
+  // Evicts every client idle for at least the timeout, calling
+  // onExpired(client) right before each one is removed. A client goes at
+  // most one WheelTick after its deadline, given expire() runs that often
+  template <typename F> void expire(Clock::time_point now, F &&onExpired) {
+    uint64_t nowTick = tickOf(now);
+    if (currentTick == 0 || nowTick < currentTick) {
+      currentTick = nowTick;
+    }
+    // After a long gap one pass over the whole wheel covers every bucket
+    uint64_t first = currentTick;
+    if (nowTick - first >= wheel.size()) {
+      first = nowTick - wheel.size() + 1;
+    }
+
+    for (uint64_t tick = first; tick <= nowTick; ++tick) {
+      uint32_t n = wheel[tick % wheel.size()];
+      while (n != None) {
+        uint32_t next = nodes[n].next;
+        if (now - nodes[n].lastSeen >= timeout) {
+          onExpired(nodes[n].client);
+          remove(n);
+        }
+        n = next;
+      }
+    }
+    currentTick = nowTick;
+  }
+
+  template <typename F> void forEach(F &&f) {
+    for (uint32_t n : live) {
+      f(nodes[n].client);
+    }
+  }
+
+private:
+  static constexpr uint32_t None = UINT32_MAX;
+  // Index kept at most half full so probe sequences stay short
+  static constexpr size_t TableSize = Capacity * 2;
+  static constexpr size_t TableMask = TableSize - 1;
+
+  struct Node {
+    Client client{};
+    uint64_t key = 0;
+    Clock::time_point lastSeen;
+    // Timer wheel bucket list
+    uint32_t bucket = None;
+    uint32_t prev = None;
+    uint32_t next = None;
+    // Position in live
+    uint32_t livePos = None;
+  };
+
+  struct IndexSlot {
+    uint64_t key = 0;
+    uint32_t node = None;
+  };
+
+  static size_t home(uint64_t key) {
+    // Fibonacci hashing spreads the mostly-equal address bits
+    return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >>
+                               (64 - std::countr_zero(TableSize)));
+  }
+
+  static uint64_t tickOf(Clock::time_point t) {
+    return static_cast<uint64_t>(t.time_since_epoch() / WheelTick);
+  }
+
+  // Deadlines round up, so by the time expire() reaches a bucket every
+  // client in it is due and none has to wait for the wheel to come around
+  static uint64_t tickAtOrAfter(Clock::time_point t) {
+    return static_cast<uint64_t>(
+        (t.time_since_epoch() + WheelTick - Clock::duration(1)) / WheelTick);
+  }
+
+  size_t findSlot(uint64_t key) const {
+    for (size_t i = home(key);; i = (i + 1) & TableMask) {
+      if (index[i].node == None) {
+        return None;
+      }
+      if (index[i].key == key) {
+        return i;
+      }
+    }
+  }
+
+  void insertSlot(uint64_t key, uint32_t n) {
+    size_t i = home(key);
+    while (index[i].node != None) {
+      i = (i + 1) & TableMask;
+    }
+    index[i] = {key, n};
+  }
+
+  // Backward-shift deletion keeps probe chains intact without tombstones
+  void eraseSlot(size_t i) {
+    for (size_t j = (i + 1) & TableMask; index[j].node != None;
+         j = (j + 1) & TableMask) {
+      size_t k = home(index[j].key);
+      // Move j into the hole unless its home lies cyclically in (i, j]
+      bool stays = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+      if (!stays) {
+        index[i] = index[j];
+        i = j;
+      }
+    }
+    index[i] = {};
+  }
+
+  void linkTimer(uint32_t n, uint64_t tick) {
+    uint32_t bucket = static_cast<uint32_t>(tick % wheel.size());
+    nodes[n].bucket = bucket;
+    nodes[n].prev = None;
+    nodes[n].next = wheel[bucket];
+    if (wheel[bucket] != None) {
+      nodes[wheel[bucket]].prev = n;
+    }
+    wheel[bucket] = n;
+  }
+
+  void unlinkTimer(uint32_t n) {
+    auto &node = nodes[n];
+    if (node.prev != None) {
+      nodes[node.prev].next = node.next;
+    } else {
+      wheel[node.bucket] = node.next;
+    }
+    if (node.next != None) {
+      nodes[node.next].prev = node.prev;
+    }
+    node.bucket = node.prev = node.next = None;
+  }
+
+  void remove(uint32_t n) {
+    unlinkTimer(n);
+    eraseSlot(findSlot(nodes[n].key));
+
+    uint32_t pos = nodes[n].livePos;
+    live[pos] = live.back();
+    nodes[live[pos]].livePos = pos;
+    live.pop_back();
+
+    nodes[n].livePos = None;
+    freeNodes.push_back(n);
+  }
+
+  Clock::duration timeout;
+  uint64_t currentTick = 0;
+  std::vector<uint32_t> wheel;
+
+  std::vector<Node> nodes;
+  std::vector<uint32_t> freeNodes;
+  // Occupied node indices, for iteration without scanning the pool
+  std::vector<uint32_t> live;
+
+  std::vector<IndexSlot> index;
+};
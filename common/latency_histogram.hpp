@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+
+// Lock-free log-linear latency histogram. Every power of two is split into
+// SubBuckets linear buckets, which keeps percentiles within ~12% of the real
+// value while recording stays a single relaxed increment.
+class LatencyHistogram {
+public:
+  void record(std::chrono::nanoseconds latency) {
+    auto ns = latency.count() > 0 ? static_cast<uint64_t>(latency.count()) : 0;
+    buckets[bucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  uint64_t count() const { return total.load(std::memory_order_relaxed); }
+
+  // Upper bound of the bucket holding the given percentile (0-100)
+  std::chrono::nanoseconds percentile(double p) const {
+    uint64_t n = count();
+    if (n == 0) {
+      return std::chrono::nanoseconds(0);
+    }
+    auto target = static_cast<uint64_t>(static_cast<double>(n) * p / 100.0);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BucketCount; ++i) {
+      seen += buckets[i].load(std::memory_order_relaxed);
+      if (seen > target) {
+        return std::chrono::nanoseconds(bucketLowerBound(i + 1));
+      }
+    }
+    return std::chrono::nanoseconds(bucketLowerBound(BucketCount));
+  }
+
+  void reset() {
+    for (auto &bucket : buckets) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+    total.store(0, std::memory_order_relaxed);
+  }
+
+private:
+  static constexpr size_t SubBucketBits = 3;
+  static constexpr size_t SubBuckets = 1 << SubBucketBits;
+  static constexpr size_t Magnitudes = 64 - SubBucketBits + 1;
+  static constexpr size_t BucketCount = Magnitudes * SubBuckets;
+
+  static constexpr size_t bucketIndex(uint64_t ns) {
+    if (ns < SubBuckets) {
+      return static_cast<size_t>(ns);
+    }
+    size_t msb = std::bit_width(ns) - 1;
+    size_t magnitude = msb - SubBucketBits + 1;
+    size_t sub = (ns >> (msb - SubBucketBits)) & (SubBuckets - 1);
+    return magnitude * SubBuckets + sub;
+  }
+
+  static constexpr uint64_t bucketLowerBound(size_t index) {
+    size_t magnitude = index / SubBuckets;
+    size_t sub = index % SubBuckets;
+    if (magnitude == 0) {
+      return sub;
+    }
+    if (magnitude >= Magnitudes) {
+      return UINT64_MAX;
+    }
+    return static_cast<uint64_t>(SubBuckets | sub) << (magnitude - 1);
+  }
+
+  std::array<std::atomic<uint64_t>, BucketCount> buckets{};
+  std::atomic<uint64_t> total{0};
+};
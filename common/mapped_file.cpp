@@ -0,0 +1,165 @@
+#include "common/mapped_file.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+namespace {
+
+std::runtime_error fileError(const std::string &what) {
+  return std::runtime_error(what + ": error " +
+                            std::to_string(GetLastError()));
+}
+
+} // namespace
+
+MappedFile::MappedFile(const std::string &path, Mode mode) : mode(mode) {
+  bool write = mode == Mode::Write;
+  file = CreateFileA(path.c_str(),
+                     write ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+                     FILE_SHARE_READ, nullptr,
+                     write ? CREATE_ALWAYS : OPEN_EXISTING,
+                     FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    file = nullptr;
+    throw fileError("Could not open " + path);
+  }
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(file, &fileSize)) {
+    CloseHandle(file);
+    throw fileError("Could not stat " + path);
+  }
+  length = static_cast<size_t>(fileSize.QuadPart);
+  map();
+}
+
+MappedFile::~MappedFile() {
+  unmap();
+  if (file) {
+    CloseHandle(file);
+  }
+}
+
+void MappedFile::resize(size_t size) {
+  if (mode != Mode::Write) {
+    throw std::runtime_error("MappedFile::resize on a read-only mapping");
+  }
+  unmap();
+  LARGE_INTEGER end;
+  end.QuadPart = static_cast<LONGLONG>(size);
+  if (!SetFilePointerEx(file, end, nullptr, FILE_BEGIN) ||
+      !SetEndOfFile(file)) {
+    throw fileError("Could not resize mapped file");
+  }
+  length = size;
+  map();
+}
+
+void MappedFile::map() {
+  // Empty files can't be mapped on Windows
+  if (length == 0) {
+    return;
+  }
+  bool write = mode == Mode::Write;
+  mapping = CreateFileMappingA(file, nullptr,
+                               write ? PAGE_READWRITE : PAGE_READONLY, 0, 0,
+                               nullptr);
+  if (!mapping) {
+    throw fileError("CreateFileMapping failed");
+  }
+  base = static_cast<uint8_t *>(MapViewOfFile(
+      mapping, write ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, length));
+  if (!base) {
+    throw fileError("MapViewOfFile failed");
+  }
+}
+
+void MappedFile::unmap() {
+  if (base) {
+    UnmapViewOfFile(base);
+    base = nullptr;
+  }
+  if (mapping) {
+    CloseHandle(mapping);
+    mapping = nullptr;
+  }
+}
+
+#else
+
+namespace {
+
+std::runtime_error fileError(const std::string &what) {
+  return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+} // namespace
+
+MappedFile::MappedFile(const std::string &path, Mode mode) : mode(mode) {
+  int flags = mode == Mode::Write ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY;
+  fd = open(path.c_str(), flags | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    throw fileError("Could not open " + path);
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw fileError("Could not stat " + path);
+  }
+  length = static_cast<size_t>(st.st_size);
+  map();
+}
+
+MappedFile::~MappedFile() {
+  unmap();
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+void MappedFile::resize(size_t size) {
+  if (mode != Mode::Write) {
+    throw std::runtime_error("MappedFile::resize on a read-only mapping");
+  }
+  unmap();
+  if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+    throw fileError("Could not resize mapped file");
+  }
+  length = size;
+  map();
+}
+
+void MappedFile::map() {
+  if (length == 0) {
+    return;
+  }
+  bool write = mode == Mode::Write;
+  void *addr = mmap(nullptr, length, write ? PROT_READ | PROT_WRITE : PROT_READ,
+                    MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) {
+    throw fileError("mmap failed");
+  }
+  base = static_cast<uint8_t *>(addr);
+}
+
+void MappedFile::unmap() {
+  if (base) {
+    munmap(base, length);
+    base = nullptr;
+  }
+}
+
+#endif
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+// A file mapped into memory as a whole. Write mode creates (or truncates) the
+// file and lets it grow through resize(), read mode maps an existing file
+// read-only. Throws std::runtime_error when the file can't be opened or
+// mapped
+class MappedFile {
+public:
+  enum class Mode { Read, Write };
+
+  MappedFile(const std::string &path, Mode mode);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  std::span<uint8_t> data() { return {base, length}; }
+  std::span<const uint8_t> data() const { return {base, length}; }
+  size_t size() const { return length; }
+
+  // Changes the file size and remaps it, earlier data() spans are invalidated.
+  // Write mode only
+  void resize(size_t size);
+
+private:
+  void map();
+  void unmap();
+
+  Mode mode;
+  uint8_t *base = nullptr;
+  size_t length = 0;
+
+#ifdef _WIN32
+  void *file = nullptr;
+  void *mapping = nullptr;
+#else
+  int fd = -1;
+#endif
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+
+// Bounded multi-producer single-consumer ring after Dmitry Vyukov's: each
+// cell's sequence tells a producer whether the cell is free for its position
+// and the consumer whether it was published, so producers only contend on
+// one counter. Neither side blocks or allocates, push() fails when the ring
+// is full.
+template <typename T, size_t Capacity> class MpscRing {
+  static_assert(std::has_single_bit(Capacity),
+                "MpscRing capacity must be a power of two");
+
+public:
+  MpscRing() {
+    for (size_t i = 0; i < Capacity; ++i) {
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // Any thread
+  bool push(const T &value) {
+    uint64_t pos = enqueuePos.load(std::memory_order_relaxed);
+    Cell *cell;
+    for (;;) {
+      cell = &cells[pos & (Capacity - 1)];
+      uint64_t seq = cell->sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<int64_t>(seq - pos);
+      if (diff == 0) {
+        if (enqueuePos.compare_exchange_weak(pos, pos + 1,
+                                             std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        // The consumer hasn't freed this cell yet, the ring is full
+        return false;
+      } else {
+        pos = enqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = value;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer thread only
+  bool pop(T &value) {
+    Cell &cell = cells[dequeuePos & (Capacity - 1)];
+    if (cell.sequence.load(std::memory_order_acquire) != dequeuePos + 1) {
+      return false;
+    }
+    value = cell.value;
+    cell.sequence.store(dequeuePos + Capacity, std::memory_order_release);
+    ++dequeuePos;
+    return true;
+  }
+
+private:
+  struct Cell {
+    std::atomic<uint64_t> sequence;
+    T value;
+  };
+
+  std::array<Cell, Capacity> cells;
+  alignas(64) std::atomic<uint64_t> enqueuePos{0};
+  // Consumer thread only
+  alignas(64) uint64_t dequeuePos = 0;
+};
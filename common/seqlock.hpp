@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Single-writer sequence lock. The writer never blocks and readers retry until
+// they copy a snapshot that wasn't overwritten mid-read. The payload lives in
+// relaxed atomic words so concurrent copies are never a data race.
+template <typename T> class Seqlock {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "Seqlock payload must be trivially copyable");
+  static constexpr size_t WordCount =
+      (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+public:
+  // Only one thread may call store() for a given Seqlock
+  void store(const T &value) {
+    std::array<uint64_t, WordCount> words{};
+    std::memcpy(words.data(), &value, sizeof(T));
+
+    uint32_t seq = sequence.load(std::memory_order_relaxed);
+    sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < WordCount; ++i) {
+      data[i].store(words[i], std::memory_order_relaxed);
+    }
+    sequence.store(seq + 2, std::memory_order_release);
+  }
+
+  T load() const {
+    std::array<uint64_t, WordCount> words;
+    uint32_t before, after;
+    do {
+      before = sequence.load(std::memory_order_acquire);
+      for (size_t i = 0; i < WordCount; ++i) {
+        words[i] = data[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = sequence.load(std::memory_order_relaxed);
+    } while ((before & 1) != 0 || before != after);
+
+    T value;
+    std::memcpy(static_cast<void *>(&value), words.data(), sizeof(T));
+    return value;
+  }
+
+private:
+  std::atomic<uint32_t> sequence{0};
+  std::array<std::atomic<uint64_t>, WordCount> data{};
+};
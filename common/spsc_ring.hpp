@@ -0,0 +1,41 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+
+// Bounded single-producer single-consumer ring. Neither side blocks or
+// allocates, push() fails when the ring is full.
+template <typename T, size_t Capacity> class SpscRing {
+  static_assert(std::has_single_bit(Capacity),
+                "SpscRing capacity must be a power of two");
+
+public:
+  // Producer thread only
+  bool push(const T &value) {
+    uint64_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == Capacity) {
+      return false;
+    }
+    entries[h % Capacity] = value;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer thread only
+  bool pop(T &value) {
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) {
+      return false;
+    }
+    value = entries[t % Capacity];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  std::array<T, Capacity> entries{};
+  alignas(64) std::atomic<uint64_t> head{0};
+  alignas(64) std::atomic<uint64_t> tail{0};
+};
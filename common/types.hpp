@@ -5,8 +5,13 @@
 #include <string>
 #include <vector>
 
+#ifdef _WIN32
 #include <winsock2.h>
 #include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#endif
 
 using byte = uint8_t;
 using ByteBuffer = std::vector<uint8_t>;
@@ -21,4 +26,20 @@ struct Connection {
     return std::string(ipStr);
   }
   uint16_t port() const { return ntohs(addr.sin_port); }
+  // Address and port packed into one integer (network byte order fields)
+  uint64_t key() const {
+    return (static_cast<uint64_t>(addr.sin_addr.s_addr) << 16) |
+           addr.sin_port;
+  }
+
+  bool operator==(const Connection &other) const {
+    return addr.sin_addr.s_addr == other.addr.sin_addr.s_addr &&
+           addr.sin_port == other.addr.sin_port;
+  }
+  bool operator<(const Connection &other) const {
+    if (addr.sin_addr.s_addr != other.addr.sin_addr.s_addr) {
+      return addr.sin_addr.s_addr < other.addr.sin_addr.s_addr;
+    }
+    return addr.sin_port < other.addr.sin_port;
+  }
 };
@@ -1,83 +1,428 @@
 #include "controller_manager.hpp"
 
+#include <algorithm>
+#include <bit>
+#include <format>
 #include <iostream>
+#include <optional>
 #include <print>
+#include <span>
+
+#ifdef PROCONDSU_HAS_PROCONTROLLER
+#include "ProControllerHid/hidio.h"
+#endif
+
+#include "async_log.hpp"
+#include "input_mapping.hpp"
+#include "pipeline_trace.hpp"
+#include "replay_source.hpp"
+#include "synthetic_source.hpp"
+
+namespace {
+
+#ifdef PROCONDSU_HAS_PROCONTROLLER
+// Reads SPI flash through a second handle with subcommand 0x10, next to the
+// one ProControllerHid reads reports from. Every handle gets its own copy
+// of the input reports, so the replies don't disturb the library
+class SpiFlashReader {
+public:
+  explicit SpiFlashReader(const char *path)
+      : device(hidio::device::open(path)) {}
+
+  bool operator()(uint32_t address, std::span<uint8_t> out) {
+    if (!device || out.size() > MaxReadSize) {
+      return false;
+    }
+    for (int attempt = 0; attempt < 3; ++attempt) {
+      // Neutral rumble, then the subcommand and its arguments
+      std::array<uint8_t, 49> request{0x01,
+                                      static_cast<uint8_t>(counter++ & 0xF),
+                                      0x00, 0x01, 0x40, 0x40, 0x00, 0x01,
+                                      0x40, 0x40, 0x10};
+      for (size_t i = 0; i < 4; ++i) {
+        request[11 + i] = static_cast<uint8_t>(address >> (8 * i));
+      }
+      request[15] = static_cast<uint8_t>(out.size());
+      if (device->write(request.data(), request.size()) < 0) {
+        return false;
+      }
+
+      // Full reports keep streaming in, skip them until the reply
+      for (int report = 0; report < 32; ++report) {
+        std::array<uint8_t, 64> reply;
+        int length = device->read(reply.data(), reply.size(), 100);
+        if (length <= 0) {
+          break;
+        }
+        if (static_cast<size_t>(length) >= 20 + out.size() &&
+            reply[0] == 0x21 && reply[14] == 0x10 &&
+            std::equal(&request[11], &request[15], &reply[15])) {
+          std::copy_n(&reply[20], out.size(), out.begin());
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+private:
+  static constexpr size_t MaxReadSize = 0x1D;
+  std::unique_ptr<hidio::device> device;
+  uint8_t counter = 0;
+};
+#endif
+
+// Physical Pro Controller through ProControllerHid
+class ProControllerSource : public InputSource {
+public:
+  ProControllerSource(std::unique_ptr<ProControllerHid::ProController> device,
+                      std::string path,
+                      std::optional<ControllerCalibration> calibration)
+      : device(std::move(device)), path(std::move(path)) {
+    if (calibration) {
+      mapping = std::make_shared<const RawInputMapping>(
+          makeRawInputMapping(*calibration));
+    }
+  }
+
+  // With the controller's calibration, raw reports skip the library's float
+  // conversion and go straight through the mapping tables. Without it the
+  // library's calibrated values are used
+  void setInputCallback(InputCallback callback) override {
+    if (!mapping) {
+      device->SetInputStatusCallback(
+          [callback = std::move(callback)](
+              const ProControllerHid::InputStatus &status) {
+            callback(mapInput(status));
+          });
+      return;
+    }
+    device->SetRawInputStatusCallback(
+        [callback = std::move(callback), mapping = mapping](
+            const ProControllerHid::RawInputStatus &status) {
+          callback(mapInput(status, *mapping));
+        });
+  }
+
+  void setPlayerLed(uint8_t player_led_bits) override {
+    device->SetPlayerLed(player_led_bits);
+  }
+
+  void setRumble(
+      const ProControllerHid::ProController::BasicRumble &rumble) override {
+    device->SetRumble(rumble);
+  }
+
+  std::string name() const override { return path; }
+
+private:
+  std::unique_ptr<ProControllerHid::ProController> device;
+  std::string path;
+  // Stick LUTs and IMU calibration, null when the calibration couldn't be
+  // read. Shared with the raw callback, which runs on the HID thread until
+  // device is gone
+  std::shared_ptr<const RawInputMapping> mapping;
+};
+
+} // namespace
 
 ControllerManager::ControllerManager() = default;
 
 ControllerManager::~ControllerManager() {
-  // Controllers will be automatically cleaned up when unique_ptrs are destroyed
+  // Sources stop delivering when their unique_ptrs are destroyed
 }
 
-void ControllerManager::initialize() {
-  auto device_paths = enumerateDevices();
-  std::println("Found {} ProController device(s)", device_paths.size());
+void ControllerManager::initialize(const InputOptions &options) {
+  if (!options.recordPath.empty()) {
+    recorder = std::make_unique<InputRecorder>(options.recordPath);
+  }
 
-  for (const auto &path : device_paths) {
-    if (connectController(path.c_str(), true)) {
-      std::println("Connected to controller: {}", path);
-    } else {
-      std::println("Failed to connect to controller: {}", path);
+  if (!options.replayPath.empty()) {
+    auto log = std::make_shared<const InputLog>(options.replayPath);
+    auto start = std::chrono::steady_clock::now();
+    // Only slots that have records, a controller unplugged for the whole
+    // recording would otherwise replay as an idle connected one
+    uint32_t slots = log->recordedSlots();
+    for (size_t slot = 0; slots != 0; ++slot, slots >>= 1) {
+      if ((slots & 1) &&
+          !addSource(std::make_unique<ReplaySource>(
+              log, slot, options.replayRealtime, start))) {
+        break;
+      }
     }
   }
+
+  for (size_t i = 0; i < options.syntheticControllers; ++i) {
+    size_t slot = getConnectedControllerCount();
+    if (!addSource(
+            std::make_unique<SyntheticSource>(slot, options.syntheticRate))) {
+      break;
+    }
+  }
+
+#ifdef PROCONDSU_HAS_PROCONTROLLER
+  hotplugThread =
+      std::jthread(std::bind_front(&ControllerManager::hotplugLoop, this));
+#endif
 }
 
-void ControllerManager::update() {
-  // Controllers update their input status via callbacks internally
-  // This method is reserved for future batch updates if needed
+void ControllerManager::hotplugLoop(std::stop_token stoken) {
+  // First scan right away, then poll. Enumeration is cheap next to a
+  // connect, which runs on its own task
+  do {
+    scanDevices();
+    std::unique_lock<std::mutex> lock(hotplugMutex);
+    hotplugCv.wait_for(lock, stoken, std::chrono::seconds(1),
+                       [] { return false; });
+  } while (!stoken.stop_requested());
+
+  for (auto &task : connectTasks) {
+    task.wait();
+  }
+}
+
+void ControllerManager::scanDevices() {
+  std::erase_if(connectTasks, [](const std::future<void> &task) {
+    return task.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+  });
+
+  auto paths = enumerateDevices();
+  std::set<std::string> present(paths.begin(), paths.end());
+
+  // Retire slots whose device is gone
+  std::vector<size_t> gone;
+  {
+    std::lock_guard<std::mutex> lock(sourcesMutex);
+    for (size_t i = 0; i < MaxControllers; ++i) {
+      if (!devicePaths[i].empty() && !present.contains(devicePaths[i])) {
+        gone.push_back(i);
+      }
+    }
+  }
+  for (size_t index : gone) {
+    retireController(index);
+  }
+
+  // Connect new devices in parallel, each handshake takes a while
+  for (const auto &path : paths) {
+    {
+      std::lock_guard<std::mutex> lock(sourcesMutex);
+      bool known = std::find(devicePaths.begin(), devicePaths.end(), path) !=
+                   devicePaths.end();
+      if (known || !connecting.insert(path).second) {
+        continue;
+      }
+    }
+
+    connectTasks.push_back(std::async(std::launch::async, [this, path] {
+      auto detected = std::chrono::steady_clock::now();
+      bool connected = connectController(path.c_str(), true);
+      auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - detected);
+      if (connected) {
+        std::println("Controller {} ready in {}", path, elapsed);
+      } else {
+        std::println("Failed to connect to controller {} after {}", path,
+                     elapsed);
+      }
+
+      std::lock_guard<std::mutex> lock(sourcesMutex);
+      connecting.erase(path);
+    }));
+  }
 }
 
 bool ControllerManager::connectController(const char *device_path,
-                                          bool enable_imu) {
+                                          [[maybe_unused]] bool enable_imu) {
+  if (getConnectedControllerCount() >= MaxControllers) {
+    std::println("All {} controller slots are in use", MaxControllers);
+    return false;
+  }
+
+  std::optional<ControllerCalibration> calibration;
+#ifdef PROCONDSU_HAS_PROCONTROLLER
   auto controller = ProControllerHid::ProController::Connect(
       device_path, enable_imu,
-      [](const char *log) { std::println("ProController: {}", log); }, false);
+      [](const char *log) { AsyncLog::text("ProController", log); }, false);
+  // After Connect, which has done the USB handshake
+  if (controller) {
+    SpiFlashReader reader(device_path);
+    calibration = readCalibration(std::ref(reader));
+    if (!calibration) {
+      std::println("Controller {}: calibration unreadable, using the "
+                   "library's conversion",
+                   device_path);
+    }
+  }
+#else
+  // ProControllerHid is only available for Windows builds
+  std::unique_ptr<ProControllerHid::ProController> controller;
+#endif
 
   if (!controller) {
     return false;
   }
+  return addSource(std::make_unique<ProControllerSource>(
+      std::move(controller), device_path, std::move(calibration)));
+}
 
-  // Set up input callback to cache the latest state
-  size_t controller_index = controllers.size();
-  controller->SetInputStatusCallback(
-      [this, controller_index](const ProControllerHid::InputStatus &status) {
-        if (controller_index < lastInputStates.size()) {
-          lastInputStates[controller_index] = status;
-        }
-      });
+bool ControllerManager::addSource(std::unique_ptr<InputSource> source) {
+  {
+    std::lock_guard<std::mutex> lock(sourcesMutex);
+    uint32_t connected = connectedSlots.load(std::memory_order_relaxed);
+    size_t controller_index = std::countr_one(connected);
+    if (controller_index >= MaxControllers) {
+      std::println("All {} controller slots are in use", MaxControllers);
+      return false;
+    }
 
-  controllers.push_back(std::move(controller));
-  lastInputStates.push_back(ProControllerHid::InputStatus{});
+    // Readers may see the slot before its first report, make that a
+    // centered controller with nothing pressed rather than what the
+    // previous source left behind. Stored before the new source can write
+    MappedInput neutral{};
+    neutral.timestamp = InputClock::now();
+    neutral.lStickX = neutral.lStickY = stickByte(0.0f);
+    neutral.rStickX = neutral.rStickY = stickByte(0.0f);
+    lastInputStates[controller_index].store(neutral);
 
+    // Cache the latest state and queue every report
+    uint32_t generation =
+        generations[controller_index].fetch_add(1, std::memory_order_acq_rel) +
+        1;
+    source->setInputCallback(
+        [this, controller_index, generation](const MappedInput &input) {
+          lastInputStates[controller_index].store(input);
+          reportQueues[controller_index].push({generation, input});
+          reportCounts[controller_index].fetch_add(
+              1, std::memory_order_relaxed);
+          PipelineTrace::record(PipelineTrace::Stage::Callback,
+                                controller_index, input.timestamp);
+          if (recorder) {
+            recorder->record(controller_index, input);
+          }
+          if (inputCallback) {
+            inputCallback(controller_index);
+          }
+        });
+
+    std::println("Controller {} in slot {}", source->name(),
+                 controller_index);
+    if (auto *device = dynamic_cast<ProControllerSource *>(source.get())) {
+      devicePaths[controller_index] = device->name();
+    }
+    sources[controller_index] = std::move(source);
+    // Start before publishing so reports flow as soon as readers see it
+    sources[controller_index]->start();
+    connectedSlots.fetch_or(1u << controller_index,
+                            std::memory_order_release);
+  }
+
+  if (connectionCallback) {
+    connectionCallback();
+  }
   return true;
 }
 
+void ControllerManager::retireController(size_t index) {
+  {
+    std::lock_guard<std::mutex> lock(sourcesMutex);
+    if (index >= MaxControllers || !sources[index]) {
+      return;
+    }
+    std::println("Controller {} in slot {} disconnected",
+                 sources[index]->name(), index);
+    connectedSlots.fetch_and(~(1u << index), std::memory_order_acq_rel);
+    sources[index].reset();
+    devicePaths[index].clear();
+  }
+
+  if (connectionCallback) {
+    connectionCallback();
+  }
+}
+
+void ControllerManager::shutdown() {
+  hotplugThread.request_stop();
+  if (hotplugThread.joinable()) {
+    hotplugThread.join();
+  }
+
+  std::lock_guard<std::mutex> lock(sourcesMutex);
+  connectedSlots.store(0, std::memory_order_release);
+  for (auto &source : sources) {
+    source.reset();
+  }
+  recorder.reset();
+}
+
 std::vector<std::string> ControllerManager::enumerateDevices() const {
+#ifdef PROCONDSU_HAS_PROCONTROLLER
   return ProControllerHid::ProController::EnumerateProControllerDevicePaths();
+#else
+  return {};
+#endif
 }
 
 size_t ControllerManager::getConnectedControllerCount() const {
-  return controllers.size();
+  return std::popcount(connectedSlots.load(std::memory_order_acquire));
+}
+
+bool ControllerManager::isConnected(size_t index) const {
+  return index < MaxControllers &&
+         (connectedSlots.load(std::memory_order_acquire) & (1u << index));
 }
 
-bool ControllerManager::getControllerInputStatus(
-    size_t index, ProControllerHid::InputStatus &status) const {
-  if (index >= lastInputStates.size()) {
+bool ControllerManager::getControllerInput(size_t index,
+                                           MappedInput &input) const {
+  if (!isConnected(index)) {
     return false;
   }
-  status = lastInputStates[index];
+  input = lastInputStates[index].load();
   return true;
 }
 
+bool ControllerManager::takeReport(size_t index, MappedInput &input) {
+  if (index >= MaxControllers) {
+    return false;
+  }
+  QueuedReport report;
+  while (reportQueues[index].pop(report)) {
+    if (isConnected(index) &&
+        report.generation ==
+            generations[index].load(std::memory_order_acquire)) {
+      input = report.input;
+      return true;
+    }
+  }
+  return false;
+}
+
+uint64_t ControllerManager::getReportCount(size_t index) const {
+  return index < MaxControllers
+             ? reportCounts[index].load(std::memory_order_relaxed)
+             : 0;
+}
+
 void ControllerManager::setPlayerLed(size_t index, uint8_t player_led_bits) {
-  if (index < controllers.size()) {
-    controllers[index]->SetPlayerLed(player_led_bits);
+  std::lock_guard<std::mutex> lock(sourcesMutex);
+  if (index < MaxControllers && sources[index]) {
+    sources[index]->setPlayerLed(player_led_bits);
   }
 }
 
 void ControllerManager::setRumble(
     size_t index, const ProControllerHid::ProController::BasicRumble &rumble) {
-  if (index < controllers.size()) {
-    controllers[index]->SetRumble(rumble);
+  std::lock_guard<std::mutex> lock(sourcesMutex);
+  if (index < MaxControllers && sources[index]) {
+    sources[index]->setRumble(rumble);
   }
 }
+
+void ControllerManager::setInputCallback(
+    std::function<void(size_t)> callback) {
+  inputCallback = std::move(callback);
+}
+
+void ControllerManager::setConnectionCallback(std::function<void()> callback) {
+  connectionCallback = std::move(callback);
+}
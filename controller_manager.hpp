@@ -1,35 +1,84 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <functional>
+#include <future>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include "ProControllerHid/ProController.h"
+#include "common/seqlock.hpp"
+#include "common/spsc_ring.hpp"
+#include "input_log.hpp"
+#include "input_source.hpp"
 #include "packet/packet.hpp"
 
+// Where controller input comes from besides attached Pro Controllers
+struct InputOptions {
+  // Virtual controllers producing scripted input, added after hardware ones
+  size_t syntheticControllers = 0;
+  // Reports per second of each virtual controller
+  unsigned syntheticRate = 250;
+
+  // Log every report to this file (see InputRecorder)
+  std::string recordPath;
+  // Replay a recorded log, one controller per recorded slot
+  std::string replayPath;
+  // Keep the recorded timing instead of replaying as fast as possible
+  bool replayRealtime = true;
+};
+
 class ControllerManager {
 public:
+  // DSU exposes four controller slots
+  static constexpr size_t MaxControllers = 4;
+
   ControllerManager();
   ~ControllerManager();
 
-  // Initialize and scan for controllers
-  void initialize();
-
-  // Update controller states (call this regularly)
-  void update();
+  // Adds the configured virtual controllers and starts the hot-plug monitor,
+  // which connects Pro Controllers in the background as they show up
+  void initialize(const InputOptions &options = {});
 
-  // Connect to a specific controller by device path
+  // Connect to a specific controller by device path, blocks for the
+  // handshake
   bool connectController(const char *device_path, bool enable_imu = false);
 
+  // Puts a source into the lowest free slot and starts it
+  bool addSource(std::unique_ptr<InputSource> source);
+
+  // Marks the slot disconnected, then stops and releases its source
+  void retireController(size_t index);
+
+  // Stops the monitor and every source, no callback runs once this returns
+  void shutdown();
+
   // Enumerate available controller device paths
   std::vector<std::string> enumerateDevices() const;
 
   // Get the number of connected controllers
   size_t getConnectedControllerCount() const;
 
+  // Slots can be free in the middle once a controller is unplugged
+  bool isConnected(size_t index) const;
+
   // Get input status from a specific controller
-  bool getControllerInputStatus(size_t index,
-                                ProControllerHid::InputStatus &status) const;
+  bool getControllerInput(size_t index, MappedInput &input) const;
+
+  // Takes the oldest report of a slot not taken yet, so every report and
+  // its IMU samples reach the dispatcher even when it falls behind. Only
+  // one thread may take reports
+  bool takeReport(size_t index, MappedInput &input);
+
+  // Reports received in a slot since startup, across every source it held
+  uint64_t getReportCount(size_t index) const;
 
   // Set player LED for a controller
   void setPlayerLed(size_t index, uint8_t player_led_bits);
@@ -38,7 +87,59 @@ public:
   void setRumble(size_t index,
                  const ProControllerHid::ProController::BasicRumble &rumble);
 
+  // Called from the HID thread with the controller index every time a
+  // controller reports new input. Must be set before initialize()
+  void setInputCallback(std::function<void(size_t)> callback);
+
+  // Called whenever a controller connects or disconnects, possibly from a
+  // background thread. Must be set before initialize()
+  void setConnectionCallback(std::function<void()> callback);
+
 private:
-  std::vector<std::unique_ptr<ProControllerHid::ProController>> controllers;
-  std::vector<ProControllerHid::InputStatus> lastInputStates;
+  // Re-enumerates devices until stopped, connecting new ones in parallel and
+  // retiring the ones that disappeared
+  void hotplugLoop(std::stop_token stoken);
+  void scanDevices();
+
+  // Fixed-capacity slots so connecting a controller never moves the state
+  // the source threads write and the request path reads
+  std::array<std::unique_ptr<InputSource>, MaxControllers> sources;
+  std::array<Seqlock<MappedInput>, MaxControllers> lastInputStates;
+
+  // Every report in arrival order, tagged with the generation of the
+  // source that produced it. A report that finds its queue full is only
+  // kept as the latest state
+  static constexpr size_t ReportQueueSize = 64;
+  struct QueuedReport {
+    uint32_t generation;
+    MappedInput input;
+  };
+  std::array<SpscRing<QueuedReport, ReportQueueSize>, MaxControllers>
+      reportQueues;
+  // Bumped whenever a slot gets a new source, so reports left over from the
+  // previous one are dropped
+  std::array<std::atomic<uint32_t>, MaxControllers> generations{};
+  // Bit per slot with a running source. A slot's bit is set only once the
+  // slot is fully set up and cleared before it is torn down, so readers
+  // never need the lock
+  std::atomic<uint32_t> connectedSlots{0};
+  // Written by the slot's source thread only, relaxed
+  std::array<std::atomic<uint64_t>, MaxControllers> reportCounts{};
+
+  // Guards sources, devicePaths and connecting
+  std::mutex sourcesMutex;
+  // Device path of every hardware slot, empty for virtual sources
+  std::array<std::string, MaxControllers> devicePaths;
+  // Paths with a connect attempt in flight
+  std::set<std::string> connecting;
+  // Connect attempts, only touched by the monitor thread
+  std::vector<std::future<void>> connectTasks;
+
+  std::mutex hotplugMutex;
+  std::condition_variable_any hotplugCv;
+  std::jthread hotplugThread;
+
+  std::unique_ptr<InputRecorder> recorder;
+  std::function<void(size_t)> inputCallback;
+  std::function<void()> connectionCallback;
 };
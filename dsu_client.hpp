@@ -1,11 +1,82 @@
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <cstring>
+
 #include "common/types.hpp"
 #include "packet/packet.hpp"
 
+// Clients that don't renew their ControllersDataRequest within this window are
+// dropped from the subscription table (cemuhook re-sends roughly every second)
+constexpr auto DsuClientTimeout = std::chrono::seconds(5);
+
+// Per-client session, lives in DsuServer's ClientRegistry which also tracks
+// when the client last renewed its registration
 struct DsuClient {
   Connection conn;
-  Packet req;
-  uint32_t packetCounter;
-  std::chrono::steady_clock::time_point lastRequest;
+  uint32_t packetCounter = 0;
+  // Slots (bitmask) whose current state answers a registration and still
+  // has to go out. The dispatcher sends them with its pushes, so packet
+  // numbers stay in send order
+  uint32_t pendingReplySlots = 0;
+
+  // Subscriptions accumulated from ControllersDataRequest registrations. MAC
+  // subscriptions beyond the fixed capacity are ignored
+  static constexpr size_t MaxMacs = 4;
+  bool allSlots = false;
+  std::array<bool, 4> slots{};
+  std::array<std::array<byte, 6>, MaxMacs> macs{};
+  size_t macCount = 0;
+
+  // Motion frames closer together than this are skipped for this client, the
+  // newest frame of every report is always sent. 0 sends every frame
+  uint64_t minMotionIntervalUs = 0;
+  std::array<uint64_t, 4> lastMotionUs{};
+
+  void subscribe(const ControllerIdentifier &id) {
+    if (id.type == 0) {
+      allSlots = true;
+    }
+    if ((id.type & ControllerIdTypeSlot) && id.slot < slots.size()) {
+      slots[id.slot] = true;
+    }
+    if (id.type & ControllerIdTypeMAC) {
+      std::array<byte, 6> mac;
+      std::memcpy(mac.data(), id.mac, mac.size());
+      for (size_t i = 0; i < macCount; ++i) {
+        if (macs[i] == mac) {
+          return;
+        }
+      }
+      if (macCount < MaxMacs) {
+        macs[macCount++] = mac;
+      }
+    }
+  }
+
+  // Decides whether a motion frame of a slot goes out to this client and
+  // remembers it if so
+  bool takeMotionFrame(size_t slot, uint64_t timestampUs, bool newest) {
+    if (slot >= lastMotionUs.size()) {
+      return newest;
+    }
+    if (!newest && timestampUs - lastMotionUs[slot] < minMotionIntervalUs) {
+      return false;
+    }
+    lastMotionUs[slot] = timestampUs;
+    return true;
+  }
+
+  bool isSubscribed(const ControllerInfoShared &info) const {
+    if (allSlots || (info.slot < slots.size() && slots[info.slot])) {
+      return true;
+    }
+    for (size_t i = 0; i < macCount; ++i) {
+      if (std::memcmp(macs[i].data(), info.macAddress, macs[i].size()) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
 };
@@ -1,243 +1,671 @@
 #include "dsu_server.hpp"
 
+#include <algorithm>
+#include <bit>
+#include <cassert>
 #include <cstring>
 #include <iostream>
 #include <print>
+#include <utility>
 
+#include "async_log.hpp"
 #include "packet/formatters.hpp"
 #include "packet/packet.hpp"
 
-DsuServer::DsuServer(const std::string &address, uint16_t port)
-    : UdpServer(address, port), packetCounter(0) {
+namespace {
+
+// The Pro Controller samples its IMU every 5 ms and packs the last three
+// samples, oldest first, into each report
+constexpr size_t MotionSamplesPerReport = 3;
+constexpr auto MotionSamplePeriod = std::chrono::microseconds(5000);
+
+uint64_t toMicros(InputClock::time_point t) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             t.time_since_epoch())
+      .count();
+}
+
+// Capture times of the samples in a report. They are spread evenly over the
+// time since the previous report, ending at the report itself, with the
+// nominal spacing for a first report or after a stall
+std::array<uint64_t, MotionSamplesPerReport>
+motionTimestamps(InputClock::time_point report,
+                 InputClock::time_point previous) {
+  auto step = (report - previous) / MotionSamplesPerReport;
+  if (previous == InputClock::time_point{} || step <= step.zero() ||
+      step > 2 * MotionSamplePeriod) {
+    step = MotionSamplePeriod;
+  }
+
+  std::array<uint64_t, MotionSamplesPerReport> timestamps;
+  for (size_t i = 0; i < MotionSamplesPerReport; ++i) {
+    timestamps[i] = toMicros(report - (MotionSamplesPerReport - 1 - i) * step);
+  }
+  return timestamps;
+}
+
+} // namespace
+
+DsuServer::DsuServer(const std::string &address, uint16_t port,
+                     size_t workers, const InputOptions &inputOptions)
+    : UdpServer(address, port, workers) {
   setMessageHandler(std::bind_front(&DsuServer::handleMessage, this));
   serverId = std::rand();
+  startTime = std::chrono::steady_clock::now();
 
-  // Initialize controller manager
-  controllerManager.initialize();
-  std::println("ControllerManager initialized with {} controller(s)",
+  controllerManager.setInputCallback(
+      std::bind_front(&DsuServer::onControllerInput, this));
+  controllerManager.setConnectionCallback(
+      std::bind_front(&DsuServer::rebuildCachedReplies, this));
+  rebuildCachedReplies();
+
+  // Initialize controller manager, Pro Controllers are picked up in the
+  // background as they connect
+  controllerManager.initialize(inputOptions);
+  std::println("ControllerManager initialized with {} virtual controller(s)",
                controllerManager.getConnectedControllerCount());
 
-  updateThread = std::jthread([this](std::stop_token stoken) {
-    while (!stoken.stop_requested()) {
-      controllerManager.update();
-      std::this_thread::sleep_for(std::chrono::milliseconds(10));
-    }
-  });
+  dispatchThread =
+      std::jthread(std::bind_front(&DsuServer::dispatchLoop, this));
 }
 
 DsuServer::~DsuServer() {
-  updateThread.request_stop();
-  if (updateThread.joinable()) {
-    updateThread.join();
+  // Silence the motors while the controllers are still there
+  rumble.stop();
+  // Input callbacks reach into the dispatcher state, stop them first
+  controllerManager.shutdown();
+  dispatchThread.request_stop();
+  if (dispatchThread.joinable()) {
+    dispatchThread.join();
+  }
+
+  std::println("Rejected datagrams: {} invalid length, {} invalid magic, {} "
+               "invalid checksum, {} parse errors, {} unknown type, {} with "
+               "the client table full, {} stats requests not allowed",
+               rejected.invalidLength.load(), rejected.invalidPacket.load(),
+               rejected.invalidChecksum.load(), rejected.parseError.load(),
+               rejected.unknownType.load(), rejected.clientTableFull.load(),
+               rejected.statsDenied.load());
+
+  SendStats stats;
+  collectSendStats(stats);
+  if (stats.datagrams > 0) {
+    std::println("Sent {} datagrams in {} syscalls ({:.3f} per packet) over "
+                 "{} flushes ({:.1f} per flush)",
+                 stats.datagrams.load(), stats.syscalls.load(),
+                 static_cast<double>(stats.syscalls) / stats.datagrams,
+                 stats.flushes.load(),
+                 static_cast<double>(stats.datagrams) / stats.flushes);
   }
+
+  std::println("Pipeline latency: {}", PipelineTrace::exportJson());
+}
+
+void DsuServer::setMaxMotionRate(unsigned rate) {
+  minMotionIntervalUs = rate > 0 ? 1'000'000 / rate : 0;
+}
+
+bool DsuServer::enableStats(const std::vector<std::string> &allowed) {
+  statsAllowed.clear();
+  for (const auto &address : allowed) {
+    in_addr addr;
+    if (inet_pton(AF_INET, address.c_str(), &addr) != 1) {
+      return false;
+    }
+    statsAllowed.push_back(addr.s_addr);
+  }
+  statsEnabled = true;
+  return true;
+}
+
+PacketHeader DsuServer::buildHeader() const {
+  PacketHeader header;
+  header.magic[0] = 'D';
+  header.magic[1] = 'S';
+  header.magic[2] = 'U';
+  header.magic[3] = 'S';
+  header.protocol = 1001;
+  header.length = 0; // will be filled later
+  header.crc32 = 0;  // will be filled later
+  header.clientServerID = serverId;
+  return header;
+}
+
+ByteBuffer DsuServer::buildPacket(MessageType type,
+                                  const ByteBuffer &body) const {
+  Packet resp;
+  resp.header = buildHeader();
+  resp.type = type;
+  resp.body = body;
+  return resp.serialize();
+}
+
+size_t DsuServer::finishReply(Reply reply, MessageType type,
+                              size_t bodySize) const {
+  size_t size = Packet::HeaderSize + bodySize;
+  Packet::finalize(reply.first(size), buildHeader(), type);
+  return size;
+}
+
+size_t DsuServer::copyReply(Reply reply, std::span<const uint8_t> datagram) {
+  assert(datagram.size() <= reply.size());
+  std::memcpy(reply.data(), datagram.data(), datagram.size());
+  return datagram.size();
+}
+
+void DsuServer::buildControllerDataPacket(
+    const ControllersDataResponse &cdrs,
+    std::span<uint8_t, ControllersDataPacketSize> datagram) const {
+  cdrs.serializeTo(
+      datagram.subspan<Packet::HeaderSize, ControllersDataResponse::WireSize>());
+  Packet::finalize(datagram, buildHeader(),
+                   MessageType::ControllersDataMessage);
+}
+
+ControllerInfoShared
+DsuServer::buildControllerInfo(size_t controller_index) const {
+  ControllerInfoShared info{};
+  info.slot = static_cast<uint8_t>(controller_index);
+
+  if (!controllerManager.isConnected(controller_index)) {
+    info.state = ControllerState::ControllerDisconnected;
+    return info;
+  }
+
+  info.state = ControllerState::ControllerConnected;
+  info.model = DeviceModel::DeviceModelFullGyro;
+  info.connection = ConnectionType::ConnectionTypeBluetooth;
+  info.batteryState = BatteryStatus::BatteryFull;
+  return info;
 }
 
 ControllersDataResponse
 DsuServer::buildControllerDataResponse(size_t controller_index) {
-  ControllersDataResponse cdrs;
-
-  if (controller_index >= controllerManager.getConnectedControllerCount()) {
+  MappedInput input;
+  if (!controllerManager.getControllerInput(controller_index, input)) {
+    ControllersDataResponse cdrs{};
+    cdrs.info = buildControllerInfo(controller_index);
     cdrs.connected = false;
     return cdrs;
   }
+  return buildControllerDataResponse(controller_index, input);
+}
 
+ControllersDataResponse
+DsuServer::buildControllerDataResponse(size_t controller_index,
+                                       const MappedInput &input) {
+  ControllersDataResponse cdrs{};
+  cdrs.info = buildControllerInfo(controller_index);
   cdrs.connected = true;
-  cdrs.info.slot = static_cast<uint8_t>(controller_index);
-  cdrs.info.state = ControllerState::ControllerConnected;
-  cdrs.info.model = DeviceModel::DeviceModelFullGyro;
-  cdrs.info.connection = ConnectionType::ConnectionTypeBluetooth;
-  cdrs.info.batteryState = BatteryStatus::BatteryFull;
-  cdrs.packetNum = packetCounter++;
-
-  ProControllerHid::InputStatus input_status;
-  if (!controllerManager.getControllerInputStatus(controller_index,
-                                                  input_status)) {
-    cdrs.connected = false;
-    return cdrs;
-  }
 
-  // Map button states from ProController to DSU format
-  cdrs.buttons.buttons1 = 0;
-  cdrs.buttons.buttons2 = 0;
-
-  auto &buttons = input_status.Buttons;
-
-  // D-Pad mapping
-  if (buttons.LeftButton)
-    cdrs.buttons.buttons1 |= ButtonDPadLeft;
-  if (buttons.DownButton)
-    cdrs.buttons.buttons1 |= ButtonDPadDown;
-  if (buttons.RightButton)
-    cdrs.buttons.buttons1 |= ButtonDPadRight;
-  if (buttons.UpButton)
-    cdrs.buttons.buttons1 |= ButtonDPadUp;
-  if (buttons.MinusButton)
-    cdrs.buttons.buttons1 |= ButtonOptions;
-  if (buttons.RStick)
-    cdrs.buttons.buttons1 |= ButtonR3;
-  if (buttons.LStick)
-    cdrs.buttons.buttons1 |= ButtonL3;
-  if (buttons.ShareButton)
-    cdrs.buttons.buttons1 |= ButtonShare;
-
-  // Action buttons mapping
-  if (buttons.YButton)
-    cdrs.buttons.buttons2 |= ButtonY;
-  if (buttons.BButton)
-    cdrs.buttons.buttons2 |= ButtonB;
-  if (buttons.AButton)
-    cdrs.buttons.buttons2 |= ButtonA;
-  if (buttons.XButton)
-    cdrs.buttons.buttons2 |= ButtonX;
-  if (buttons.RButton)
-    cdrs.buttons.buttons2 |= ButtonR1;
-  if (buttons.LButton)
-    cdrs.buttons.buttons2 |= ButtonL1;
-  if (buttons.RZButton)
-    cdrs.buttons.buttons2 |= ButtonR2;
-  if (buttons.LZButton)
-    cdrs.buttons.buttons2 |= ButtonL2;
-
-  // Home button
-  cdrs.home = buttons.HomeButton;
-
-  // Stick mapping (convert from float [-1.0, 1.0] to uint8_t [0, 255])
-  cdrs.lStickX =
-      static_cast<uint8_t>((input_status.LeftStick.X + 1.0f) * 127.5f);
-  cdrs.lStickY =
-      static_cast<uint8_t>((input_status.LeftStick.Y + 1.0f) * 127.5f);
-  cdrs.rStickX =
-      static_cast<uint8_t>((input_status.RightStick.X + 1.0f) * 127.5f);
-  cdrs.rStickY =
-      static_cast<uint8_t>((input_status.RightStick.Y + 1.0f) * 127.5f);
-
-  // Sensor data mapping
-  if (input_status.HasSensorStatus) {
-    auto &sensor = input_status.Sensors[0];
-    cdrs.accel.x = sensor.Accelerometer.X;
-    cdrs.accel.y = sensor.Accelerometer.Y;
-    cdrs.accel.z = sensor.Accelerometer.Z;
-    cdrs.gyro.x = sensor.Gyroscope.X;
-    cdrs.gyro.y = sensor.Gyroscope.Y;
-    cdrs.gyro.z = sensor.Gyroscope.Z;
-    cdrs.timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
-                         input_status.Timestamp.time_since_epoch())
-                         .count();
+  // Buttons and sticks were mapped by the input source
+  cdrs.buttons.buttons1 = input.buttons1;
+  cdrs.buttons.buttons2 = input.buttons2;
+  cdrs.home = input.home;
+  cdrs.lStickX = input.lStickX;
+  cdrs.lStickY = input.lStickY;
+  cdrs.rStickX = input.rStickX;
+  cdrs.rStickY = input.rStickY;
+
+  // Sensor data mapping, the newest sample carries the report timestamp
+  if (input.hasSensorStatus) {
+    setMotion(cdrs, input.sensors[MotionSamplesPerReport - 1],
+              toMicros(input.timestamp));
   }
 
   return cdrs;
 }
 
+void DsuServer::setMotion(ControllersDataResponse &cdrs,
+                          const ProControllerHid::ImuSensorStatus &sensor,
+                          uint64_t timestampUs) {
+  cdrs.accel.x = sensor.Accelerometer.X;
+  cdrs.accel.y = sensor.Accelerometer.Y;
+  cdrs.accel.z = sensor.Accelerometer.Z;
+  cdrs.gyro.x = sensor.Gyroscope.X;
+  cdrs.gyro.y = sensor.Gyroscope.Y;
+  cdrs.gyro.z = sensor.Gyroscope.Z;
+  cdrs.timestamp = timestampUs;
+}
+
 ControllersInfoResponse DsuServer::buildControllersInfoResponse() {
   ControllersInfoResponse cirs;
-  size_t controller_count = controllerManager.getConnectedControllerCount();
-
-  for (size_t i = 0; i < controller_count; ++i) {
-    ControllerInfoResponse cir;
-    cir.info.slot = static_cast<uint8_t>(i);
-    cir.info.state = ControllerState::ControllerConnected;
-    cir.info.model = DeviceModel::DeviceModelFullGyro;
-    cir.info.connection = ConnectionType::ConnectionTypeBluetooth;
-    cir.info.batteryState = BatteryStatus::BatteryFull;
+
+  for (size_t i = 0; i < ControllerManager::MaxControllers; ++i) {
+    if (!controllerManager.isConnected(i)) {
+      continue;
+    }
+    ControllerInfoResponse cir{};
+    cir.info = buildControllerInfo(i);
     cirs.info.push_back(cir);
   }
 
   return cirs;
 }
 
-ByteBuffer DsuServer::handleMessage(const ByteBuffer &buf, Connection conn) {
-  auto n = buf.size();
-  if (n < 20) {
-    return {};
+ControllersMotorsResponse
+DsuServer::buildControllersMotorsResponse(size_t controller_index) const {
+  ControllersMotorsResponse cmirs{};
+  cmirs.info = buildControllerInfo(controller_index);
+  cmirs.motorCount = RumbleDispatcher::MotorCount;
+  return cmirs;
+}
+
+ServerStatsResponse DsuServer::buildServerStatsResponse() {
+  ServerStatsResponse stats{};
+  stats.uptimeMs = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - startTime)
+          .count());
+
+  SendStats sent;
+  collectSendStats(sent);
+  stats.datagramsSent = sent.datagrams.load();
+  stats.sendSyscalls = sent.syscalls.load();
+
+  stats.rejectedLength = rejected.invalidLength.load();
+  stats.rejectedMagic = rejected.invalidPacket.load();
+  stats.rejectedChecksum = rejected.invalidChecksum.load();
+  stats.rejectedParse = rejected.parseError.load();
+  stats.rejectedType = rejected.unknownType.load();
+  stats.rejectedTableFull = rejected.clientTableFull.load();
+  stats.rejectedStats = rejected.statsDenied.load();
+  stats.logDropped = AsyncLog::dropped();
+  stats.traceDropped = PipelineTrace::dropped();
+
+  auto micros = [](std::chrono::nanoseconds ns) {
+    return static_cast<uint32_t>(std::min<int64_t>(ns.count() / 1000,
+                                                   UINT32_MAX));
+  };
+  for (size_t i = 0; i < stats.controllers.size(); ++i) {
+    auto &controller = stats.controllers[i];
+    const auto &latency =
+        PipelineTrace::histogram(PipelineTrace::Stage::Send, i);
+    controller.connected = controllerManager.isConnected(i);
+    controller.reports = controllerManager.getReportCount(i);
+    controller.latencyP50Us = micros(latency.percentile(50));
+    controller.latencyP99Us = micros(latency.percentile(99));
+    controller.latencyP999Us = micros(latency.percentile(99.9));
+  }
+
+  std::lock_guard<std::mutex> lock(clientsMutex);
+  stats.clientCount = static_cast<uint32_t>(clients.size());
+  clients.forEach([&](const DsuClient &client) {
+    if (stats.clients.size() == ServerStatsResponse::MaxClients) {
+      return;
+    }
+    ClientStats entry;
+    std::memcpy(entry.address, &client.conn.addr.sin_addr.s_addr, 4);
+    entry.port = client.conn.port();
+    // Packet numbers count up from zero per client
+    entry.packetsSent = client.packetCounter;
+    stats.clients.push_back(entry);
+  });
+  return stats;
+}
+
+void DsuServer::rebuildCachedReplies() {
+  std::lock_guard<std::mutex> lock(cacheRebuildMutex);
+  auto previous = cachedReplies.load();
+
+  auto replies = std::make_shared<CachedReplies>();
+  replies->version = previous ? previous->version + 1 : 0;
+  replies->controllersInfo =
+      buildPacket(MessageType::ControllersInfoMessage,
+                  buildControllersInfoResponse().serialize());
+  for (size_t i = 0; i < replies->motorsInfo.size(); ++i) {
+    replies->motorsInfo[i] =
+        buildPacket(MessageType::ControllersMotorsInfoMessage,
+                    buildControllersMotorsResponse(i).serialize());
+  }
+
+  cachedReplies.store(std::move(replies));
+}
+
+DsuClient *DsuServer::registerClient(const ControllerIdentifier &id,
+                                     Connection conn) {
+  auto now = std::chrono::steady_clock::now();
+  expireClients(now);
+
+  // Logged asynchronously, this runs under clientsMutex on the request path
+  auto [client, inserted] = clients.touch(conn, now);
+  if (!client) {
+    // Every datagram from an unknown sender lands here while the table is
+    // full, so only the 1st, 2nd, 4th, 8th... one is logged
+    uint64_t count =
+        rejected.clientTableFull.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (std::has_single_bit(count)) {
+      AsyncLog::client("ignored, client table full", conn);
+    }
+    return nullptr;
+  }
+  if (inserted) {
+    client->conn = conn;
+    client->minMotionIntervalUs = minMotionIntervalUs;
+    AsyncLog::client("subscribed", conn);
+  }
+  client->subscribe(id);
+  return client;
+}
+
+void DsuServer::expireClients(std::chrono::steady_clock::time_point now) {
+  clients.expire(now, [](const DsuClient &client) {
+    AsyncLog::client("timed out", client.conn);
+  });
+}
+
+void DsuServer::onControllerInput(size_t controller_index) {
+  {
+    std::lock_guard<std::mutex> lock(dispatchMutex);
+    pendingControllers |= 1u << controller_index;
   }
-  if (std::strncmp((const char *)buf.data(), "DSUC", 4) != 0) {
-    return {};
+  dispatchCv.notify_one();
+}
+
+void DsuServer::dispatchLoop(std::stop_token stoken) {
+  while (true) {
+    uint32_t pending;
+    bool replies;
+    {
+      std::unique_lock<std::mutex> lock(dispatchMutex);
+      if (!dispatchCv.wait(lock, stoken, [this] {
+            return pendingControllers != 0 || pendingReplies;
+          })) {
+        return;
+      }
+      pending = std::exchange(pendingControllers, 0);
+      replies = std::exchange(pendingReplies, false);
+    }
+
+    // Queue registration replies and updates for every pending controller,
+    // then send the whole cycle in one flush
+    if (replies) {
+      queueRegistrationReplies();
+    }
+    for (size_t i = 0; pending != 0; ++i, pending >>= 1) {
+      if (pending & 1) {
+        pushControllerData(i);
+      }
+    }
+    flush(pushBatch);
+
+    auto sent = PipelineTrace::Clock::now();
+    for (const auto &report : pushReports) {
+      PipelineTrace::record(PipelineTrace::Stage::Send, report.controller,
+                            report.timestamp, sent);
+    }
+    pushReports.clear();
+
+    // Keep the per-thread trace rings from filling up
+    auto now = std::chrono::steady_clock::now();
+    if (PipelineTrace::collectDue() ||
+        now - lastTraceCollect > std::chrono::milliseconds(100)) {
+      PipelineTrace::collect();
+      lastTraceCollect = now;
+    }
   }
+}
+
+void DsuServer::queueRegistrationReplies() {
+  std::array<uint8_t, ControllersDataPacketSize> datagram;
+  std::lock_guard<std::mutex> lock(clientsMutex);
+  for (const auto &conn : pendingReplyClients) {
+    // Gone if it expired in the meantime
+    auto *client = clients.find(conn);
+    if (!client) {
+      continue;
+    }
+    uint32_t slots = std::exchange(client->pendingReplySlots, 0);
+    for (size_t i = 0; slots != 0; ++i, slots >>= 1) {
+      if (slots & 1) {
+        ControllersDataResponse cdrs = buildControllerDataResponse(i);
+        cdrs.packetNum = client->packetCounter++;
+        buildControllerDataPacket(cdrs, datagram);
+        pushBatch.add(datagram, conn);
+      }
+    }
+  }
+  pendingReplyClients.clear();
+}
+
+void DsuServer::pushControllerData(size_t controller_index) {
+  // Every report since the last cycle, oldest first, so none of their IMU
+  // samples are lost when reports arrive faster than the dispatcher runs
+  MappedInput input;
+  while (controllerManager.takeReport(controller_index, input)) {
+    pushReport(controller_index, input);
+  }
+}
+
+void DsuServer::pushReport(size_t controller_index, const MappedInput &input) {
+  PipelineTrace::record(PipelineTrace::Stage::Dispatch, controller_index,
+                        input.timestamp);
+
+  // Same state for every subscriber, only the packet number and the motion
+  // sample differ
+  ControllersDataResponse cdrs =
+      buildControllerDataResponse(controller_index, input);
+  PipelineTrace::record(PipelineTrace::Stage::Build, controller_index,
+                        input.timestamp);
+  std::array<uint8_t, ControllersDataPacketSize> datagram;
+  auto now = std::chrono::steady_clock::now();
+
+  // One frame per IMU sample. A report without motion data, or one with the
+  // timestamp of the previous report, only sends its newest state, since no
+  // time has passed to spread samples over
+  bool repeated = input.timestamp == lastReportTimestamps[controller_index];
+  size_t frameCount =
+      input.hasSensorStatus && !repeated ? MotionSamplesPerReport : 1;
+  auto timestamps = motionTimestamps(input.timestamp,
+                                     lastReportTimestamps[controller_index]);
+  lastReportTimestamps[controller_index] = input.timestamp;
+
+  std::lock_guard<std::mutex> lock(clientsMutex);
+  expireClients(now);
+  bool pushed = false;
+  for (size_t frame = MotionSamplesPerReport - frameCount;
+       frame < MotionSamplesPerReport; ++frame) {
+    bool newest = frame + 1 == MotionSamplesPerReport;
+    if (input.hasSensorStatus) {
+      setMotion(cdrs, input.sensors[frame], timestamps[frame]);
+    }
+    size_t queued = pushBatch.size();
+    clients.forEach([&](DsuClient &client) {
+      if (!client.isSubscribed(cdrs.info) ||
+          !client.takeMotionFrame(controller_index, cdrs.timestamp, newest)) {
+        return;
+      }
+      cdrs.packetNum = client.packetCounter++;
+      buildControllerDataPacket(cdrs, datagram);
+      pushBatch.add(datagram, client.conn);
+    });
+    // Traced per frame rather than per client, so the rings keep up with
+    // many subscribers
+    if (pushBatch.size() != queued) {
+      PipelineTrace::record(PipelineTrace::Stage::Serialize, controller_index,
+                            input.timestamp);
+      pushed = true;
+    }
+  }
+  if (pushed) {
+    pushReports.push_back({controller_index, input.timestamp});
+  }
+}
+
+void DsuServer::countRejected(DeserializeError err) {
+  switch (err) {
+  case DeserializeError::ErrInvalidLength:
+    rejected.invalidLength.fetch_add(1, std::memory_order_relaxed);
+    break;
+  case DeserializeError::ErrInvalidPacket:
+    rejected.invalidPacket.fetch_add(1, std::memory_order_relaxed);
+    break;
+  case DeserializeError::ErrInvalidChecksum:
+    rejected.invalidChecksum.fetch_add(1, std::memory_order_relaxed);
+    break;
+  default:
+    rejected.parseError.fetch_add(1, std::memory_order_relaxed);
+    break;
+  }
+}
 
-  Packet req;
+size_t DsuServer::handleMessage(std::span<const uint8_t> buf, Connection conn,
+                                Reply reply) {
+  PacketView req;
   auto err = req.deserialize(buf);
   if (err != DeserializeError::None) {
-    return {};
+    countRejected(err);
+    return 0;
   }
 
   // std::println("{}", req);
-  ByteBuffer body;
-
-  switch (req.type) {
-  case MessageType::ProtocolVersionMessage: {
-    ProtocolVersionResponse pvrs;
-    pvrs.version = 1001;
-    body = pvrs.serialize();
-  } break;
-  case MessageType::ControllersInfoMessage: {
-    ControllersInfoRequest cirq;
-    err = cirq.deserialize(req.body);
-    if (err != DeserializeError::None) {
-      std::println("ControllersInfoMessage :: Deserialize error :: {}",
-                   static_cast<uint8_t>(err));
-      return {};
-    }
-
-    ControllersInfoResponse cirs = buildControllersInfoResponse();
-    body = cirs.serialize();
-  } break;
-  case MessageType::ControllersDataMessage: {
-    ControllersDataRequest cdrq;
-    err = cdrq.deserialize(req.body);
-    if (err != DeserializeError::None) {
-      std::println("ControllersDataMessage :: Deserialize error :: {}",
-                   static_cast<uint8_t>(err));
-      return {};
-    }
-
-    ControllersDataResponse cdrs =
-        buildControllerDataResponse(cdrq.controllerId.slot);
-    body = cdrs.serialize();
-  } break;
-  case MessageType::ControllersMotorsInfoMessage: {
-    ControllersMotorsRequest cmim;
-    err = cmim.deserialize(req.body);
-    if (err != DeserializeError::None) {
-      std::println("ControllersMotorsInfoMessage :: Deserialize error :: {}",
-                   static_cast<uint8_t>(err));
-      return {};
-    }
-    ControllersMotorsResponse cmirs;
-    cmirs.info.slot = cmim.controllerId.slot;
-    cmirs.info.state = ControllerState::ControllerConnected;
-    cmirs.info.model = DeviceModel::DeviceModelFullGyro;
-    cmirs.info.connection = ConnectionType::ConnectionTypeBluetooth;
-    cmirs.info.batteryState = BatteryStatus::BatteryFull;
-    cmirs.motorCount = 2; // Pro Controller has left and right motors
-    body = cmirs.serialize();
-  } break;
-  case MessageType::ControllersMotorsRumbleMessage: {
-    ControllersMotorsRumbleRequest cmrq;
-    err = cmrq.deserialize(req.body);
-    if (err != DeserializeError::None) {
-      std::println("ControllersMotorsRumbleMessage :: Deserialize error :: {}",
-                   static_cast<uint8_t>(err));
-      return {};
-    }
-    // TODO: Map rumble intensity to ProController and send
-  } break;
-  default:
-    return {};
+
+  using Handler = size_t (DsuServer::*)(const PacketView &, Connection, Reply);
+  struct Route {
+    MessageType type;
+    Handler handler;
+  };
+  static constexpr std::array Routes = {
+      Route{MessageType::ProtocolVersionMessage,
+            &DsuServer::dispatch<ProtocolVersionRequest,
+                                 &DsuServer::onProtocolVersion>},
+      Route{MessageType::ControllersInfoMessage,
+            &DsuServer::dispatch<ControllersInfoRequest,
+                                 &DsuServer::onControllersInfo>},
+      Route{MessageType::ControllersDataMessage,
+            &DsuServer::dispatch<ControllersDataRequest,
+                                 &DsuServer::onControllersData>},
+      Route{MessageType::ControllersMotorsInfoMessage,
+            &DsuServer::dispatch<ControllersMotorsRequest,
+                                 &DsuServer::onMotorsInfo>},
+      Route{MessageType::ControllersMotorsRumbleMessage,
+            &DsuServer::dispatch<ControllersMotorsRumbleRequest,
+                                 &DsuServer::onRumble>},
+      Route{MessageType::ServerStatsMessage,
+            &DsuServer::dispatch<ServerStatsRequest,
+                                 &DsuServer::onServerStats>},
+  };
+
+  for (const auto &route : Routes) {
+    if (route.type == req.type) {
+      return (this->*route.handler)(req, conn, reply);
+    }
   }
+  rejected.unknownType.fetch_add(1, std::memory_order_relaxed);
+  return 0;
+}
 
-  PacketHeader header;
-  header.magic[0] = 'D';
-  header.magic[1] = 'S';
-  header.magic[2] = 'U';
-  header.magic[3] = 'S';
-  header.protocol = 1001;
-  header.length = static_cast<uint16_t>(sizeof(MessageType) + body.size());
-  header.crc32 = 0; // will be filled later
-  header.clientServerID = serverId;
+template <typename Request,
+          size_t (DsuServer::*Handler)(const Request &, Connection,
+                                       DsuServer::Reply)>
+size_t DsuServer::dispatch(const PacketView &req, Connection conn,
+                           Reply reply) {
+  Request request{};
+  auto err = request.deserialize(req.body);
+  if (err != DeserializeError::None) {
+    countRejected(err);
+    AsyncLog::deserializeError(req.type, err, conn);
+    return 0;
+  }
+  return (this->*Handler)(request, conn, reply);
+}
 
-  Packet resp;
-  resp.header = header;
-  resp.type = req.type;
-  resp.body = body;
-  return resp.serialize();
+size_t DsuServer::onProtocolVersion(const ProtocolVersionRequest &,
+                                    Connection, Reply reply) {
+  ProtocolVersionResponse pvrs;
+  pvrs.version = 1001;
+  pvrs.serializeTo(
+      reply.subspan<Packet::HeaderSize, ProtocolVersionResponse::WireSize>());
+  return finishReply(reply, MessageType::ProtocolVersionMessage,
+                     ProtocolVersionResponse::WireSize);
+}
+
+size_t DsuServer::onControllersInfo(const ControllersInfoRequest &,
+                                    Connection, Reply reply) {
+  return copyReply(reply, cachedReplies.load()->controllersInfo);
+}
+
+size_t DsuServer::onControllersData(const ControllersDataRequest &req,
+                                    Connection conn, Reply) {
+  // Reply with the current state of the requested slot and of every
+  // connected controller the registration matches, later updates are pushed
+  // as input arrives. That can be several datagrams, so the dispatcher sends
+  // them in its next cycle, numbered in order with the pushes
+  auto &id = req.controllerId;
+  {
+    std::lock_guard<std::mutex> lock(clientsMutex);
+    auto *client = registerClient(id, conn);
+    if (!client) {
+      return 0;
+    }
+    uint32_t slots = 0;
+    for (size_t i = 0; i < client->slots.size(); ++i) {
+      auto info = buildControllerInfo(i);
+      bool requested = (id.type & ControllerIdTypeSlot) && id.slot == i;
+      bool matched = info.state == ControllerState::ControllerConnected &&
+                     client->isSubscribed(info);
+      if (requested || matched) {
+        slots |= 1u << i;
+      }
+    }
+    if (slots == 0) {
+      return 0;
+    }
+    if (client->pendingReplySlots == 0) {
+      pendingReplyClients.push_back(conn);
+    }
+    client->pendingReplySlots |= slots;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(dispatchMutex);
+    pendingReplies = true;
+  }
+  dispatchCv.notify_one();
+  return 0;
+}
+
+size_t DsuServer::onMotorsInfo(const ControllersMotorsRequest &req,
+                               Connection, Reply reply) {
+  auto slot = req.controllerId.slot;
+  auto replies = cachedReplies.load();
+  if (slot < replies->motorsInfo.size()) {
+    return copyReply(reply, replies->motorsInfo[slot]);
+  }
+  buildControllersMotorsResponse(slot).serializeTo(
+      reply.subspan<Packet::HeaderSize, ControllersMotorsResponse::WireSize>());
+  return finishReply(reply, MessageType::ControllersMotorsInfoMessage,
+                     ControllersMotorsResponse::WireSize);
+}
+
+size_t DsuServer::onRumble(const ControllersMotorsRumbleRequest &req,
+                           Connection, Reply) {
+  // Only slot-based addressing, controllers don't report a MAC. Rumble has
+  // no reply
+  auto &id = req.controllerId;
+  if ((id.type & ControllerIdTypeSlot) &&
+      controllerManager.isConnected(id.slot)) {
+    rumble.post(id.slot, req.motorID, req.intensity);
+  }
+  return 0;
+}
+
+size_t DsuServer::onServerStats(const ServerStatsRequest &, Connection conn,
+                                Reply reply) {
+  static_assert(Packet::HeaderSize + ServerStatsResponse::MaxWireSize <=
+                    UdpBackend::MaxReplySize,
+                "Stats reply must fit the reply buffer");
+  // Only for loopback and allowed addresses, anyone else could use the
+  // reply to learn client addresses or to amplify spoofed traffic
+  uint32_t addr = conn.addr.sin_addr.s_addr;
+  bool loopback = (ntohl(addr) >> 24) == 127;
+  if (!statsEnabled ||
+      (!loopback && std::ranges::find(statsAllowed, addr) ==
+                        statsAllowed.end())) {
+    rejected.statsDenied.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+  }
+  size_t bodySize = buildServerStatsResponse().serializeTo(
+      reply.subspan(Packet::HeaderSize));
+  return finishReply(reply, MessageType::ServerStatsMessage, bodySize);
 }
@@ -1,31 +1,181 @@
 #pragma once
 
-#include <map>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
 #include <mutex>
+#include <span>
 #include <string>
 #include <thread>
+#include <vector>
 
+#include "common/client_registry.hpp"
 #include "common/types.hpp"
 #include "controller_manager.hpp"
 #include "dsu_client.hpp"
+#include "pipeline_trace.hpp"
+#include "rumble_dispatcher.hpp"
 #include "udp_server.hpp"
 
 class DsuServer : public UdpServer {
 public:
-  DsuServer(const std::string &address = "127.0.0.1", uint16_t port = 26760);
+  DsuServer(const std::string &address = "127.0.0.1", uint16_t port = 26760,
+            size_t workers = 1, const InputOptions &inputOptions = {});
   ~DsuServer();
 
+  // Caps the motion frame rate sent to each client, 0 (default) sends all
+  // three IMU samples of every report. Call before start()
+  void setMaxMotionRate(unsigned rate);
+  // Answers ServerStatsMessage from loopback and the listed IPv4 addresses.
+  // Off by default: the reply lists client addresses and is far larger
+  // than the request. False if an address doesn't parse. Call before
+  // start()
+  bool enableStats(const std::vector<std::string> &allowed = {});
+
 private:
-  ByteBuffer handleMessage(const ByteBuffer &buf, Connection conn);
+  // Complete datagram a request handler writes its reply into
+  using Reply = std::span<uint8_t, UdpBackend::MaxReplySize>;
+
+  // Looks the message type up in a compile-time dispatch table
+  size_t handleMessage(std::span<const uint8_t> buf, Connection conn,
+                       Reply reply);
+  // Dispatch table entry: decodes the body as Request, straight from the
+  // receive buffer, and runs Handler on it
+  template <typename Request,
+            size_t (DsuServer::*Handler)(const Request &, Connection, Reply)>
+  size_t dispatch(const PacketView &req, Connection conn, Reply reply);
+
+  // Request handlers. Each returns the length of the reply datagram it
+  // wrote, 0 for none
+  size_t onProtocolVersion(const ProtocolVersionRequest &req, Connection conn,
+                           Reply reply);
+  size_t onControllersInfo(const ControllersInfoRequest &req, Connection conn,
+                           Reply reply);
+  size_t onControllersData(const ControllersDataRequest &req, Connection conn,
+                           Reply reply);
+  size_t onMotorsInfo(const ControllersMotorsRequest &req, Connection conn,
+                      Reply reply);
+  size_t onRumble(const ControllersMotorsRumbleRequest &req, Connection conn,
+                  Reply reply);
+  size_t onServerStats(const ServerStatsRequest &req, Connection conn,
+                       Reply reply);
+
+  // Adds header, type and CRC around a body already serialized at
+  // reply[Packet::HeaderSize..], returns the datagram length
+  size_t finishReply(Reply reply, MessageType type, size_t bodySize) const;
+  // Replies with a prebuilt datagram
+  static size_t copyReply(Reply reply, std::span<const uint8_t> datagram);
+
+  PacketHeader buildHeader() const;
+  // Wraps a serialized message body into a DSUS packet
+  ByteBuffer buildPacket(MessageType type, const ByteBuffer &body) const;
+  // Serializes a complete data packet in place, header and CRC included
+  void buildControllerDataPacket(
+      const ControllersDataResponse &cdrs,
+      std::span<uint8_t, ControllersDataPacketSize> datagram) const;
 
   // Helper to convert ProController input to DSU format
+  ControllerInfoShared buildControllerInfo(size_t controller_index) const;
   ControllersDataResponse buildControllerDataResponse(size_t controller_index);
+  ControllersDataResponse
+  buildControllerDataResponse(size_t controller_index,
+                              const MappedInput &input);
+  // Fills accel, gyro and motion timestamp from one IMU sample
+  static void setMotion(ControllersDataResponse &cdrs,
+                        const ProControllerHid::ImuSensorStatus &sensor,
+                        uint64_t timestampUs);
   ControllersInfoResponse buildControllersInfoResponse();
+  ControllersMotorsResponse
+  buildControllersMotorsResponse(size_t controller_index) const;
+  // Snapshot of the counters for ServerStatsMessage
+  ServerStatsResponse buildServerStatsResponse();
+
+  // Re-serializes the cached replies, called on connection changes
+  void rebuildCachedReplies();
+
+  // Registers a ControllersDataRequest subscription for the sender, returns
+  // nullptr when the client table is full
+  DsuClient *registerClient(const ControllerIdentifier &id, Connection conn);
+  // Drops clients that stopped renewing their registration
+  void expireClients(std::chrono::steady_clock::time_point now);
+  // Counts a dropped inbound datagram under its rejection reason
+  void countRejected(DeserializeError err);
+
+  // Called from the HID thread, wakes the dispatcher for that controller
+  void onControllerInput(size_t controller_index);
+  // Sends pending controller updates as soon as the HID callback signals them
+  void dispatchLoop(std::stop_token stoken);
+  // Queues the registration replies of every client in pendingReplyClients
+  void queueRegistrationReplies();
+  // Queues every report of a controller taken since the last cycle
+  void pushControllerData(size_t controller_index);
+  // Queues one report for every subscribed client, one packet per IMU sample
+  void pushReport(size_t controller_index, const MappedInput &input);
 
   ControllerManager controllerManager;
+  RumbleDispatcher rumble{controllerManager};
 
   uint32_t serverId;
-  uint32_t packetCounter;
+  std::chrono::steady_clock::time_point startTime;
+
+  // Complete datagrams for replies that only change when a controller
+  // connects or disconnects. Rebuilt as a whole and swapped in atomically
+  struct CachedReplies {
+    uint64_t version;
+    ByteBuffer controllersInfo;
+    std::array<ByteBuffer, ControllerManager::MaxControllers> motorsInfo;
+  };
+  std::atomic<std::shared_ptr<const CachedReplies>> cachedReplies;
+  std::mutex cacheRebuildMutex;
+
+  ClientRegistry<DsuClient> clients{DsuClientTimeout};
+  // Clients with pendingReplySlots set, guarded by clientsMutex
+  std::vector<Connection> pendingReplyClients;
+  std::mutex clientsMutex;
+
+  // Bitmask of controllers with input not yet pushed to subscribers
+  uint32_t pendingControllers = 0;
+  // Registration replies are waiting in pendingReplyClients
+  bool pendingReplies = false;
+  std::mutex dispatchMutex;
+  std::condition_variable_any dispatchCv;
+
+  // Inbound datagrams dropped before a reply was built, by reason
+  struct RejectCounters {
+    std::atomic<uint64_t> invalidLength{0};
+    std::atomic<uint64_t> invalidPacket{0};
+    std::atomic<uint64_t> invalidChecksum{0};
+    std::atomic<uint64_t> parseError{0};
+    std::atomic<uint64_t> unknownType{0};
+    // Registrations refused because the client table was full
+    std::atomic<uint64_t> clientTableFull{0};
+    // Stats requests with stats off or from an address not allowed
+    std::atomic<uint64_t> statsDenied{0};
+  } rejected;
+
+  // Reports pushed to at least one client in the current dispatch cycle,
+  // with the controller and timestamp of each, only touched by the
+  // dispatcher thread
+  struct PushedReport {
+    size_t controller;
+    InputClock::time_point timestamp;
+  };
+  SendBatch pushBatch;
+  std::vector<PushedReport> pushReports;
+  std::chrono::steady_clock::time_point lastTraceCollect;
+
+  // Timestamp of the previous report per controller, to place the IMU samples
+  // of the next one. Dispatcher thread only
+  std::array<InputClock::time_point, ControllerManager::MaxControllers>
+      lastReportTimestamps{};
+
+  // Set from setMaxMotionRate, copied into each new client
+  uint64_t minMotionIntervalUs = 0;
+
+  // Set from enableStats, addresses in network byte order
+  bool statsEnabled = false;
+  std::vector<uint32_t> statsAllowed;
 
-  std::jthread updateThread;
+  std::jthread dispatchThread;
 };
@@ -0,0 +1,129 @@
+#include "input_log.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <print>
+#include <stdexcept>
+
+namespace {
+
+// File growth step, keeps remapping rare
+constexpr size_t GrowRecords = 64 * 1024;
+
+} // namespace
+
+InputRecorder::InputRecorder(const std::string &path)
+    : file(path, MappedFile::Mode::Write),
+      start(std::chrono::steady_clock::now()),
+      rings(std::make_unique<std::array<Ring, MaxSlots>>()) {
+  file.resize(sizeof(InputLogHeader) + GrowRecords * sizeof(InputLogRecord));
+  InputLogHeader header;
+  header.recordSize = sizeof(InputLogRecord);
+  std::memcpy(file.data().data(), &header, sizeof(header));
+
+  writerThread =
+      std::jthread(std::bind_front(&InputRecorder::writeLoop, this));
+  std::println("Recording input to {}", path);
+}
+
+InputRecorder::~InputRecorder() {
+  writerThread.request_stop();
+  if (writerThread.joinable()) {
+    writerThread.join();
+  }
+  drain();
+  file.resize(sizeof(InputLogHeader) + recordCount * sizeof(InputLogRecord));
+
+  uint64_t dropped = 0;
+  for (const auto &ring : *rings) {
+    dropped += ring.dropped.load();
+  }
+  std::println("Recorded {} input reports ({} dropped)", recordCount,
+               dropped);
+}
+
+void InputRecorder::record(size_t slot,
+                           const MappedInput &input) {
+  if (slot >= MaxSlots) {
+    return;
+  }
+  auto &ring = (*rings)[slot];
+  uint64_t head = ring.head.load(std::memory_order_relaxed);
+  if (head - ring.tail.load(std::memory_order_acquire) == RingSize) {
+    ring.dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  auto &entry = ring.entries[head % RingSize];
+  entry.offsetNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  entry.slot = static_cast<uint32_t>(slot);
+  entry.reserved = 0;
+  entry.input = input;
+  ring.head.store(head + 1, std::memory_order_release);
+}
+
+void InputRecorder::writeLoop(std::stop_token stoken) {
+  while (!stoken.stop_requested()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    drain();
+  }
+}
+
+void InputRecorder::drain() {
+  for (auto &ring : *rings) {
+    uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    uint64_t head = ring.head.load(std::memory_order_acquire);
+    for (; tail != head; ++tail) {
+      append(ring.entries[tail % RingSize]);
+    }
+    ring.tail.store(tail, std::memory_order_release);
+  }
+
+  // Publish the count last so a log cut short by a crash stays readable
+  std::memcpy(file.data().data() + offsetof(InputLogHeader, recordCount),
+              &recordCount, sizeof(recordCount));
+}
+
+void InputRecorder::append(const InputLogRecord &record) {
+  size_t offset = sizeof(InputLogHeader) + recordCount * sizeof(record);
+  if (offset + sizeof(record) > file.size()) {
+    file.resize(file.size() + GrowRecords * sizeof(record));
+  }
+  std::memcpy(file.data().data() + offset, &record, sizeof(record));
+  ++recordCount;
+}
+
+InputLog::InputLog(const std::string &path)
+    : file(path, MappedFile::Mode::Read) {
+  InputLogHeader header;
+  if (file.size() < sizeof(header)) {
+    throw std::runtime_error(path + " is not an input log");
+  }
+  std::memcpy(&header, file.data().data(), sizeof(header));
+  if (header.magic != InputLogHeader::Magic) {
+    throw std::runtime_error(path + " is not an input log");
+  }
+  if (header.recordSize != sizeof(InputLogRecord)) {
+    throw std::runtime_error(path + " was recorded by an incompatible build");
+  }
+
+  size_t available =
+      (file.size() - sizeof(header)) / sizeof(InputLogRecord);
+  size_t count = std::min<size_t>(header.recordCount, available);
+  entries = {reinterpret_cast<const InputLogRecord *>(file.data().data() +
+                                                      sizeof(header)),
+             count};
+}
+
+uint32_t InputLog::recordedSlots() const {
+  uint32_t slots = 0;
+  for (const auto &record : entries) {
+    if (record.slot < 32) {
+      slots |= 1u << record.slot;
+    }
+  }
+  return slots;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <thread>
+
+#include "ProControllerHid/ProController.h"
+#include "common/mapped_file.hpp"
+#include "input_mapping.hpp"
+
+// On-disk layout of a recorded input session: a header followed by
+// fixed-size records in arrival order. Records hold the MappedInput as laid
+// out in memory, so logs are only portable between builds for the same
+// platform (checked through recordSize)
+struct InputLogHeader {
+  static constexpr std::array<char, 8> Magic{'P', 'C', 'D', 'S', 'L', 'O',
+                                             'G', '2'};
+
+  std::array<char, 8> magic = Magic;
+  uint32_t recordSize = 0;
+  uint32_t reserved = 0;
+  // Records fully written, the file may be longer than that
+  uint64_t recordCount = 0;
+};
+
+struct InputLogRecord {
+  // Arrival time relative to the start of the recording
+  int64_t offsetNs;
+  uint32_t slot;
+  uint32_t reserved;
+  MappedInput input;
+};
+
+// Appends every report handed to record() to a memory-mapped log. The
+// caller only copies the report into a per-slot ring, a writer thread moves
+// the rings into the file, so recording never blocks the source thread.
+// Reports that find their ring full are dropped and counted
+class InputRecorder {
+public:
+  static constexpr size_t MaxSlots = 4;
+
+  explicit InputRecorder(const std::string &path);
+  ~InputRecorder();
+
+  // Safe to call concurrently for different slots, one thread per slot
+  void record(size_t slot, const MappedInput &input);
+
+private:
+  static constexpr size_t RingSize = 1024; // Power of two
+
+  // Single-producer single-consumer ring for one slot
+  struct Ring {
+    std::array<InputLogRecord, RingSize> entries;
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    std::atomic<uint64_t> dropped{0};
+  };
+
+  void writeLoop(std::stop_token stoken);
+  // Moves everything queued so far into the file
+  void drain();
+  void append(const InputLogRecord &record);
+
+  MappedFile file;
+  uint64_t recordCount = 0;
+  std::chrono::steady_clock::time_point start;
+  std::unique_ptr<std::array<Ring, MaxSlots>> rings;
+
+  std::jthread writerThread;
+};
+
+// Read-only view of a recorded log
+class InputLog {
+public:
+  // Throws std::runtime_error if the file isn't a compatible log
+  explicit InputLog(const std::string &path);
+
+  std::span<const InputLogRecord> records() const { return entries; }
+  // Bit per slot with at least one record, slots beyond 31 are ignored
+  uint32_t recordedSlots() const;
+
+private:
+  MappedFile file;
+  std::span<const InputLogRecord> entries;
+};
@@ -0,0 +1,274 @@
+#include "input_mapping.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#include "packet/packet.hpp"
+
+namespace {
+
+// DSU bit for each ButtonStatus bit, low byte goes to buttons1, the next to
+// buttons2 and bit 16 is HOME. Bits without a DSU counterpart map to 0
+constexpr std::array<uint32_t, 24> ButtonBits = {
+    // YButton, XButton, BButton, AButton, RSR, RSL, RButton, RZButton
+    ButtonY << 8, ButtonX << 8, ButtonB << 8, ButtonA << 8, 0, 0,
+    ButtonR1 << 8, ButtonR2 << 8,
+    // Minus, Plus, RStick, LStick, Home, Share, Unknown3, ChargingGrip
+    ButtonOptions, 0, ButtonR3, ButtonL3, 1u << 16, ButtonShare, 0, 0,
+    // Down, Up, Right, Left, LSR, LSL, LButton, LZButton
+    ButtonDPadDown, ButtonDPadUp, ButtonDPadRight, ButtonDPadLeft, 0, 0,
+    ButtonL1 << 8, ButtonL2 << 8};
+
+// One table per byte of the button word, so the whole mapping is three
+// lookups ORed together
+constexpr auto ButtonTables = [] {
+  std::array<std::array<uint32_t, 256>, 3> tables{};
+  for (size_t byte = 0; byte < tables.size(); ++byte) {
+    for (uint32_t value = 0; value < 256; ++value) {
+      uint32_t mapped = 0;
+      for (size_t bit = 0; bit < 8; ++bit) {
+        if (value & (1u << bit)) {
+          mapped |= ButtonBits[byte * 8 + bit];
+        }
+      }
+      tables[byte][value] = mapped;
+    }
+  }
+  return tables;
+}();
+
+// SPI flash layout of the calibration data. User blocks start with a magic
+// that is only present when the user calibrated on a Switch
+constexpr uint32_t FactoryImuAddress = 0x6020;
+constexpr uint32_t FactoryLeftStickAddress = 0x603D;
+constexpr uint32_t FactoryRightStickAddress = 0x6046;
+constexpr uint32_t LeftStickParamsAddress = 0x6086;
+constexpr uint32_t RightStickParamsAddress = 0x6098;
+constexpr uint32_t UserLeftStickAddress = 0x8010;
+constexpr uint32_t UserRightStickAddress = 0x801B;
+constexpr uint32_t UserImuAddress = 0x8026;
+constexpr std::array<uint8_t, 2> UserCalibrationMagic = {0xB2, 0xA1};
+
+// Reads a calibration block, preferring the user copy when it has the magic
+template <size_t Size>
+bool readBlock(const SpiReader &read, uint32_t userAddress,
+               uint32_t factoryAddress, std::array<uint8_t, Size> &block) {
+  std::array<uint8_t, Size + 2> user;
+  if (!read(userAddress, user)) {
+    return false;
+  }
+  if (user[0] == UserCalibrationMagic[0] &&
+      user[1] == UserCalibrationMagic[1]) {
+    std::copy(user.begin() + 2, user.end(), block.begin());
+    return true;
+  }
+  return read(factoryAddress, block);
+}
+
+// Packed pair of 12-bit values
+std::pair<uint16_t, uint16_t> unpack12(const uint8_t *data) {
+  return {static_cast<uint16_t>(((data[1] << 8) & 0xF00) | data[0]),
+          static_cast<uint16_t>((data[2] << 4) | (data[1] >> 4))};
+}
+
+StickCalibration makeStick(const uint8_t *center, const uint8_t *below,
+                           const uint8_t *above,
+                           std::span<const uint8_t, 18> params) {
+  auto [centerX, centerY] = unpack12(center);
+  auto [belowX, belowY] = unpack12(below);
+  auto [aboveX, aboveY] = unpack12(above);
+  StickCalibration cal;
+  cal.centerX = centerX;
+  cal.centerY = centerY;
+  cal.minX = static_cast<uint16_t>(centerX - belowX);
+  cal.minY = static_cast<uint16_t>(centerY - belowY);
+  cal.maxX = static_cast<uint16_t>(centerX + aboveX);
+  cal.maxY = static_cast<uint16_t>(centerY + aboveY);
+  cal.deadzone = static_cast<uint16_t>(((params[4] << 8) & 0xF00) | params[3]);
+  return cal;
+}
+
+// One axis relative to its center, scaled by the distance to the end it
+// is deflected towards
+float stickAxis(int raw, int center, int min, int max) {
+  int offset = raw - center;
+  if (offset == 0) {
+    return 0.0f;
+  }
+  float axis = offset > 0 ? static_cast<float>(offset) /
+                                static_cast<float>(max - center)
+                          : static_cast<float>(center - raw) /
+                                static_cast<float>(min - center);
+  return std::clamp(axis, -1.0f, 1.0f);
+}
+
+int16_t readInt16(const uint8_t *data) {
+  return static_cast<int16_t>(data[0] | (data[1] << 8));
+}
+
+float accel(const ImuAxisCalibration &cal, int16_t raw) {
+  return static_cast<float>(static_cast<double>(raw) * 4.0 /
+                            static_cast<double>(cal.coeff - cal.origin));
+}
+
+float gyro(const ImuAxisCalibration &cal, int16_t raw) {
+  return static_cast<float>(static_cast<double>(raw - cal.origin) *
+                            0.0027777778 * 936.0 /
+                            static_cast<double>(cal.coeff - cal.origin));
+}
+
+uint32_t buttonWord(const ProControllerHid::ButtonStatus &buttons) {
+  uint32_t raw;
+  static_assert(sizeof(raw) == sizeof(buttons));
+  std::memcpy(&raw, &buttons, sizeof(raw));
+  return raw & 0xffffff;
+}
+
+void setButtons(MappedInput &input, uint32_t raw) {
+  uint32_t mapped = mapButtons(raw);
+  input.buttons1 = static_cast<uint8_t>(mapped);
+  input.buttons2 = static_cast<uint8_t>(mapped >> 8);
+  input.home = (mapped >> 16) & 1;
+}
+
+void setStick(uint8_t &x, uint8_t &y, const StickLut &lut,
+              const ProControllerHid::StickStatus &stick) {
+  uint16_t mappedX = lut.x[stick.AxisX];
+  uint16_t mappedY = lut.y[stick.AxisY];
+  if (mappedX & mappedY & StickLut::InDeadzone) {
+    x = y = stickByte(0.0f);
+    return;
+  }
+  x = static_cast<uint8_t>(mappedX);
+  y = static_cast<uint8_t>(mappedY);
+}
+
+} // namespace
+
+std::optional<ControllerCalibration> readCalibration(const SpiReader &read) {
+  std::array<uint8_t, 24> imu;
+  std::array<uint8_t, 9> left;
+  std::array<uint8_t, 9> right;
+  std::array<uint8_t, 18> leftParams;
+  std::array<uint8_t, 18> rightParams;
+  if (!readBlock(read, UserImuAddress, FactoryImuAddress, imu) ||
+      !readBlock(read, UserLeftStickAddress, FactoryLeftStickAddress, left) ||
+      !readBlock(read, UserRightStickAddress, FactoryRightStickAddress,
+                 right) ||
+      !read(LeftStickParamsAddress, leftParams) ||
+      !read(RightStickParamsAddress, rightParams)) {
+    return std::nullopt;
+  }
+  return ControllerCalibration{parseLeftStick(left, leftParams),
+                               parseRightStick(right, rightParams),
+                               parseImu(imu)};
+}
+
+StickCalibration parseLeftStick(std::span<const uint8_t, 9> data,
+                                std::span<const uint8_t, 18> params) {
+  return makeStick(&data[3], &data[6], &data[0], params);
+}
+
+StickCalibration parseRightStick(std::span<const uint8_t, 9> data,
+                                 std::span<const uint8_t, 18> params) {
+  return makeStick(&data[0], &data[3], &data[6], params);
+}
+
+ImuCalibration parseImu(std::span<const uint8_t, 24> data) {
+  ImuCalibration cal;
+  for (size_t axis = 0; axis < 3; ++axis) {
+    // Accelerometer
+    cal[axis].origin = readInt16(&data[axis * 2]);
+    cal[axis].coeff = static_cast<uint16_t>(readInt16(&data[6 + axis * 2]));
+    // Gyroscope
+    cal[3 + axis].origin = readInt16(&data[12 + axis * 2]);
+    cal[3 + axis].coeff =
+        static_cast<uint16_t>(readInt16(&data[18 + axis * 2]));
+  }
+  return cal;
+}
+
+ProControllerHid::Vector2f stickAxes(const StickCalibration &cal, int rawX,
+                                     int rawY) {
+  if (std::abs(rawX - cal.centerX) <= cal.deadzone &&
+      std::abs(rawY - cal.centerY) <= cal.deadzone) {
+    return {0.0f, 0.0f};
+  }
+  return {stickAxis(rawX, cal.centerX, cal.minX, cal.maxX),
+          stickAxis(rawY, cal.centerY, cal.minY, cal.maxY)};
+}
+
+ProControllerHid::ImuSensorStatus
+imuSample(const ImuCalibration &cal,
+          const ProControllerHid::SensorStatus &raw) {
+  return {{accel(cal[0], raw.Accelerometer.X),
+           accel(cal[1], raw.Accelerometer.Y),
+           accel(cal[2], raw.Accelerometer.Z)},
+          {gyro(cal[3], raw.Gyroscope.X), gyro(cal[4], raw.Gyroscope.Y),
+           gyro(cal[5], raw.Gyroscope.Z)}};
+}
+
+StickLut makeStickLut(const StickCalibration &cal) {
+  StickLut lut;
+  for (int raw = 0; raw < 4096; ++raw) {
+    // Outside the deadzone on the other axis, so each axis converts alone
+    lut.x[raw] = stickByte(stickAxis(raw, cal.centerX, cal.minX, cal.maxX));
+    lut.y[raw] = stickByte(stickAxis(raw, cal.centerY, cal.minY, cal.maxY));
+    if (std::abs(raw - cal.centerX) <= cal.deadzone) {
+      lut.x[raw] |= StickLut::InDeadzone;
+    }
+    if (std::abs(raw - cal.centerY) <= cal.deadzone) {
+      lut.y[raw] |= StickLut::InDeadzone;
+    }
+  }
+  return lut;
+}
+
+RawInputMapping makeRawInputMapping(const ControllerCalibration &cal) {
+  return {makeStickLut(cal.leftStick), makeStickLut(cal.rightStick),
+          cal.imu};
+}
+
+uint8_t stickByte(float axis) {
+  // Stick mapping (convert from float [-1.0, 1.0] to uint8_t [0, 255])
+  return static_cast<uint8_t>((std::clamp(axis, -1.0f, 1.0f) + 1.0f) * 127.5f);
+}
+
+uint32_t mapButtons(uint32_t raw) {
+  return ButtonTables[0][raw & 0xff] | ButtonTables[1][(raw >> 8) & 0xff] |
+         ButtonTables[2][(raw >> 16) & 0xff];
+}
+
+MappedInput mapInput(const ProControllerHid::InputStatus &status) {
+  MappedInput input{};
+  input.timestamp = InputClock::now();
+  setButtons(input, buttonWord(status.Buttons));
+  input.lStickX = stickByte(status.LeftStick.X);
+  input.lStickY = stickByte(status.LeftStick.Y);
+  input.rStickX = stickByte(status.RightStick.X);
+  input.rStickY = stickByte(status.RightStick.Y);
+  input.hasSensorStatus = status.HasSensorStatus;
+  std::copy(std::begin(status.Sensors), std::end(status.Sensors),
+            input.sensors);
+  return input;
+}
+
+MappedInput mapInput(const ProControllerHid::RawInputStatus &status,
+                     const RawInputMapping &mapping) {
+  MappedInput input{};
+  input.timestamp = InputClock::now();
+  setButtons(input, buttonWord(status.Buttons));
+  setStick(input.lStickX, input.lStickY, mapping.leftStick, status.LeftStick);
+  setStick(input.rStickX, input.rStickY, mapping.rightStick,
+           status.RightStick);
+
+  input.hasSensorStatus = status.HasSensorStatus;
+  if (status.HasSensorStatus) {
+    for (size_t i = 0; i < std::size(status.Sensors); ++i) {
+      input.sensors[i] = imuSample(mapping.imu, status.Sensors[i]);
+    }
+  }
+  return input;
+}
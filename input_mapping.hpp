@@ -0,0 +1,118 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+
+#include "ProControllerHid/ProController.h"
+
+// Clock of MappedInput timestamps. ProControllerHid stamps its reports with
+// high_resolution_clock, which is the adjustable system_clock in libstdc++,
+// so reports are stamped again when they are mapped
+using InputClock = std::chrono::steady_clock;
+
+// Controller state already in DSU terms, produced once per report by the
+// input source so the dispatcher only copies bytes for every client
+struct MappedInput {
+  InputClock::time_point timestamp;
+  uint8_t buttons1; // DSU button bitmasks, see GamePadButtons
+  uint8_t buttons2;
+  bool home;
+  uint8_t lStickX;
+  uint8_t lStickY;
+  uint8_t rStickX;
+  uint8_t rStickY;
+  bool hasSensorStatus;
+  ProControllerHid::ImuSensorStatus sensors[3];
+};
+
+// Raw 12-bit stick calibration as stored in the controller's SPI flash
+struct StickCalibration {
+  uint16_t centerX;
+  uint16_t centerY;
+  // Raw values at full deflection, min is left and down
+  uint16_t minX;
+  uint16_t minY;
+  uint16_t maxX;
+  uint16_t maxY;
+  // Raw distance from center that still reads as centered
+  uint16_t deadzone;
+};
+
+// One IMU axis: the raw offset and the raw reading that maps to the
+// reference value (1 G, 936 dps)
+struct ImuAxisCalibration {
+  int16_t origin;
+  uint16_t coeff;
+};
+
+// Accelerometer X, Y, Z, then gyroscope X, Y, Z
+using ImuCalibration = std::array<ImuAxisCalibration, 6>;
+
+struct ControllerCalibration {
+  StickCalibration leftStick;
+  StickCalibration rightStick;
+  ImuCalibration imu;
+};
+
+// Reads size bytes of SPI flash at address into the span
+using SpiReader = std::function<bool(uint32_t address, std::span<uint8_t>)>;
+
+// Reads the calibration the way ProControllerHid does: user calibration
+// where the controller has one, factory calibration otherwise
+std::optional<ControllerCalibration> readCalibration(const SpiReader &read);
+
+// Stick calibration blocks, 9 bytes of packed 12-bit pairs. The left stick
+// stores above center, center, below center, the right stick center, below,
+// above. params is the 18-byte stick parameter block with the deadzone
+StickCalibration parseLeftStick(std::span<const uint8_t, 9> data,
+                                std::span<const uint8_t, 18> params);
+StickCalibration parseRightStick(std::span<const uint8_t, 9> data,
+                                 std::span<const uint8_t, 18> params);
+// Six-axis calibration block: accelerometer origins and coefficients, then
+// gyroscope origins and coefficients, little-endian 16-bit each
+ImuCalibration parseImu(std::span<const uint8_t, 24> data);
+
+// Stick axis as ProControllerHid converts it, in [-1.0, 1.0]. Both axes
+// read 0 while the stick is inside the deadzone on both
+ProControllerHid::Vector2f stickAxes(const StickCalibration &cal, int rawX,
+                                     int rawY);
+// Sensor sample as ProControllerHid converts it, in G and rotations per
+// second
+ProControllerHid::ImuSensorStatus
+imuSample(const ImuCalibration &cal,
+          const ProControllerHid::SensorStatus &raw);
+
+// DSU stick byte for every raw axis value. Bit 8 marks values inside the
+// deadzone, which read centered only when the other axis is inside too
+struct StickLut {
+  static constexpr uint16_t InDeadzone = 0x100;
+  std::array<uint16_t, 4096> x;
+  std::array<uint16_t, 4096> y;
+};
+
+StickLut makeStickLut(const StickCalibration &cal);
+
+// Everything needed to map raw reports of one controller
+struct RawInputMapping {
+  StickLut leftStick;
+  StickLut rightStick;
+  ImuCalibration imu;
+};
+
+RawInputMapping makeRawInputMapping(const ControllerCalibration &cal);
+
+// DSU buttons1 | buttons2 << 8 | home << 16 for a 24-bit ButtonStatus word
+uint32_t mapButtons(uint32_t raw);
+// DSU byte for a stick axis in [-1.0, 1.0] (127 = centered)
+uint8_t stickByte(float axis);
+
+// For sources that already deliver calibrated floats
+MappedInput mapInput(const ProControllerHid::InputStatus &status);
+// For raw HID reports: sticks through the LUTs, IMU with the controller's
+// calibration. Gives the same result as the library's own conversion
+MappedInput mapInput(const ProControllerHid::RawInputStatus &status,
+                     const RawInputMapping &mapping);
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "ProControllerHid/ProController.h"
+#include "input_mapping.hpp"
+
+// Something that produces controller input for one DSU slot: a physical Pro
+// Controller, or a virtual one for running the server without hardware
+class InputSource {
+public:
+  using InputCallback = std::function<void(const MappedInput &)>;
+
+  virtual ~InputSource() = default;
+
+  // Called with every new input report, possibly from a source-owned thread.
+  // Set before start()
+  virtual void setInputCallback(InputCallback callback) = 0;
+
+  // Begins delivering input. Hardware sources report on their own as soon as
+  // they are connected, so the default does nothing
+  virtual void start() {}
+
+  virtual void setPlayerLed(uint8_t player_led_bits) { (void)player_led_bits; }
+  virtual void
+  setRumble(const ProControllerHid::ProController::BasicRumble &rumble) {
+    (void)rumble;
+  }
+
+  // Short description for logs
+  virtual std::string name() const = 0;
+};
@@ -1,10 +1,17 @@
+#include <algorithm>
 #include <condition_variable>
 #include <csignal>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "dsu_server.hpp"
+
+#ifdef _WIN32
 #include <windows.h>
 
 std::mutex mtx;
@@ -21,18 +28,94 @@ BOOL ConsoleCtrlHandler(DWORD dwCtrlType) {
   return FALSE;
 }
 
+bool installCtrlCHandler() {
+  return SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
+}
+
 void waitForCtrlC() {
   std::unique_lock<std::mutex> lock(mtx);
   cv.wait(lock, [] { return shutdown_requested; });
 }
+#else
+#include <pthread.h>
+
+sigset_t shutdown_signals;
 
-int main() {
-  if (!SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE)) {
+// Blocks SIGINT/SIGTERM in every thread (must run before any thread is
+// started) so the main thread can pick them up with sigwait
+bool installCtrlCHandler() {
+  sigemptyset(&shutdown_signals);
+  sigaddset(&shutdown_signals, SIGINT);
+  sigaddset(&shutdown_signals, SIGTERM);
+  return pthread_sigmask(SIG_BLOCK, &shutdown_signals, nullptr) == 0;
+}
+
+void waitForCtrlC() {
+  int sig;
+  sigwait(&shutdown_signals, &sig);
+}
+#endif
+
+int main(int argc, char **argv) {
+  // --workers N: receive threads, each with its own SO_REUSEPORT socket.
+  // 0 picks one per hardware thread
+  // --synthetic N: add N virtual controllers with scripted input
+  // --rate HZ: report rate of the virtual controllers (up to 1000)
+  // --record FILE: log every input report to FILE
+  // --replay FILE: play back a recorded log, --replay-fast without the
+  // recorded timing
+  // --motion-rate HZ: cap on motion frames per second sent to each client
+  // --stats: answer server stats requests from loopback, --stats-allow ADDR
+  // also from ADDR (repeatable, implies --stats)
+  size_t workers = 1;
+  unsigned motionRate = 0;
+  bool stats = false;
+  std::vector<std::string> statsAllowed;
+  InputOptions inputOptions;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+      workers = std::strtoul(argv[++i], nullptr, 10);
+      if (workers == 0) {
+        workers = std::max(1u, std::thread::hardware_concurrency());
+      }
+    } else if (std::strcmp(argv[i], "--synthetic") == 0 && i + 1 < argc) {
+      inputOptions.syntheticControllers = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+      inputOptions.syntheticRate = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      inputOptions.recordPath = argv[++i];
+    } else if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+      inputOptions.replayPath = argv[++i];
+    } else if (std::strcmp(argv[i], "--replay-fast") == 0) {
+      inputOptions.replayRealtime = false;
+    } else if (std::strcmp(argv[i], "--motion-rate") == 0 && i + 1 < argc) {
+      motionRate = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--stats") == 0) {
+      stats = true;
+    } else if (std::strcmp(argv[i], "--stats-allow") == 0 && i + 1 < argc) {
+      stats = true;
+      statsAllowed.push_back(argv[++i]);
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--workers N] [--synthetic N] [--rate HZ] [--record FILE]"
+                   " [--replay FILE] [--replay-fast] [--motion-rate HZ]"
+                   " [--stats] [--stats-allow ADDR]"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  if (!installCtrlCHandler()) {
     std::cerr << "ERROR: Could not set console control handler" << std::endl;
     return 1;
   }
 
-  DsuServer server("0.0.0.0", 26760);
+  DsuServer server("0.0.0.0", 26760, workers, inputOptions);
+  server.setMaxMotionRate(motionRate);
+  if (stats && !server.enableStats(statsAllowed)) {
+    std::cerr << "ERROR: Invalid --stats-allow address" << std::endl;
+    return 1;
+  }
 
   server.start();
   waitForCtrlC();
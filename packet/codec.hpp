@@ -0,0 +1,173 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "common/types.hpp"
+#include "utils.hpp"
+
+// Compile-time wire format. A struct lists its members once, in wire order:
+//
+//   static constexpr auto Fields = codec::fields(&Touch::active, &Touch::id);
+//   WIRE_FORMAT(Prefix)
+//
+// and gets WireSize plus encode and decode members that write every field
+// at an offset known at compile time, little-endian like the rest of the
+// protocol. Supported members are integers, floats, enums (as their
+// underlying type), bool (one byte, 0 or 1), fixed arrays of those and
+// nested described structs.
+namespace codec {
+
+template <typename... Members> struct FieldList {
+  std::tuple<Members...> members;
+};
+
+template <typename... Members>
+constexpr FieldList<Members...> fields(Members... members) {
+  return {{members...}};
+}
+
+template <typename T>
+concept Described = requires { T::Fields; };
+
+template <typename T> constexpr size_t wireSizeOf();
+
+template <typename Class, typename Member>
+constexpr size_t fieldSize(Member Class::*) {
+  return wireSizeOf<Member>();
+}
+
+template <typename... Members>
+constexpr size_t wireSize(const FieldList<Members...> &list) {
+  return std::apply(
+      [](auto... members) { return (size_t{0} + ... + fieldSize(members)); },
+      list.members);
+}
+
+template <typename T> struct ArrayTraits {
+  static constexpr bool IsArray = false;
+};
+template <typename T, size_t N> struct ArrayTraits<T[N]> {
+  static constexpr bool IsArray = true;
+  using Element = T;
+  static constexpr size_t Size = N;
+};
+template <typename T, size_t N> struct ArrayTraits<std::array<T, N>> {
+  static constexpr bool IsArray = true;
+  using Element = T;
+  static constexpr size_t Size = N;
+};
+
+template <typename T> constexpr size_t wireSizeOf() {
+  if constexpr (std::is_same_v<T, bool>) {
+    return 1;
+  } else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>) {
+    return sizeof(T);
+  } else if constexpr (ArrayTraits<T>::IsArray) {
+    return ArrayTraits<T>::Size *
+           wireSizeOf<typename ArrayTraits<T>::Element>();
+  } else {
+    static_assert(Described<T>, "No wire format for this member type");
+    return wireSize(T::Fields);
+  }
+}
+
+template <typename T> constexpr size_t WireSizeOf = wireSizeOf<T>();
+
+// Wire offset of every field of a described struct
+template <Described T>
+constexpr auto FieldOffsets = std::apply(
+    [](auto... members) {
+      std::array<size_t, sizeof...(members)> offsets{};
+      size_t offset = 0;
+      size_t i = 0;
+      ((offsets[i++] = offset, offset += fieldSize(members)), ...);
+      return offsets;
+    },
+    T::Fields.members);
+
+template <typename T> void encodeAt(const T &value, uint8_t *out);
+template <typename T> void decodeAt(T &value, const uint8_t *in);
+
+template <typename T, size_t... I>
+void encodeFields(const T &value, uint8_t *out, std::index_sequence<I...>) {
+  (encodeAt(value.*std::get<I>(T::Fields.members), out + FieldOffsets<T>[I]),
+   ...);
+}
+
+template <typename T, size_t... I>
+void decodeFields(T &value, const uint8_t *in, std::index_sequence<I...>) {
+  (decodeAt(value.*std::get<I>(T::Fields.members), in + FieldOffsets<T>[I]),
+   ...);
+}
+
+template <typename T> void encodeAt(const T &value, uint8_t *out) {
+  if constexpr (std::is_same_v<T, bool>) {
+    *out = value ? 1 : 0;
+  } else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>) {
+    std::memcpy(out, &value, sizeof(T));
+  } else if constexpr (ArrayTraits<T>::IsArray) {
+    using Element = typename ArrayTraits<T>::Element;
+    for (size_t i = 0; i < ArrayTraits<T>::Size; ++i) {
+      encodeAt(value[i], out + i * WireSizeOf<Element>);
+    }
+  } else {
+    constexpr size_t Count = std::tuple_size_v<decltype(T::Fields.members)>;
+    encodeFields(value, out, std::make_index_sequence<Count>());
+  }
+}
+
+template <typename T> void decodeAt(T &value, const uint8_t *in) {
+  if constexpr (std::is_same_v<T, bool>) {
+    value = *in != 0;
+  } else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>) {
+    std::memcpy(&value, in, sizeof(T));
+  } else if constexpr (ArrayTraits<T>::IsArray) {
+    using Element = typename ArrayTraits<T>::Element;
+    for (size_t i = 0; i < ArrayTraits<T>::Size; ++i) {
+      decodeAt(value[i], in + i * WireSizeOf<Element>);
+    }
+  } else {
+    constexpr size_t Count = std::tuple_size_v<decltype(T::Fields.members)>;
+    decodeFields(value, in, std::make_index_sequence<Count>());
+  }
+}
+
+// How decoding treats a buffer longer than the struct: Prefix reads the
+// leading WireSize bytes, Exact rejects it
+enum class Match { Prefix, Exact };
+
+template <Match M, Described T>
+DeserializeError decode(T &value, std::span<const uint8_t> in) {
+  constexpr size_t Size = WireSizeOf<T>;
+  if (in.size() < Size || (M == Match::Exact && in.size() != Size)) {
+    return DeserializeError::ErrInvalidLength;
+  }
+  decodeAt(value, in.data());
+  return DeserializeError::None;
+}
+
+template <Described T> ByteBuffer serialize(const T &value) {
+  ByteBuffer result(WireSizeOf<T>);
+  encodeAt(value, result.data());
+  return result;
+}
+
+} // namespace codec
+
+// Members of a struct with a Fields list, see codec above. M is a
+// codec::Match
+#define WIRE_FORMAT(M)                                                         \
+  static constexpr size_t WireSize = codec::wireSize(Fields);                  \
+  void serializeTo(std::span<uint8_t, WireSize> out) const {                   \
+    codec::encodeAt(*this, out.data());                                        \
+  }                                                                            \
+  ByteBuffer serialize() const { return codec::serialize(*this); }             \
+  DeserializeError deserialize(std::span<const uint8_t> buf) {                 \
+    return codec::decode<codec::Match::M>(*this, buf);                         \
+  }
@@ -2,9 +2,34 @@
 
 #include "packet.hpp"
 
+#include <algorithm>
 #include <format>
+#include <span>
 #include <string_view>
 
+template <>
+struct std::formatter<DeserializeError> : std::formatter<std::string_view> {
+  constexpr auto parse(std::format_parse_context &ctx) { return ctx.begin(); }
+
+  auto format(const DeserializeError &e, std::format_context &ctx) const {
+    switch (e) {
+    case DeserializeError::None:
+      return std::format_to(ctx.out(), "No Error");
+    case DeserializeError::ErrInvalidPacket:
+      return std::format_to(ctx.out(), "Invalid Packet");
+    case DeserializeError::ErrInvalidLength:
+      return std::format_to(ctx.out(), "Invalid Length");
+    case DeserializeError::ErrParseError:
+      return std::format_to(ctx.out(), "Parse Error");
+    case DeserializeError::ErrInvalidChecksum:
+      return std::format_to(ctx.out(), "Invalid Checksum");
+    default:
+      return std::format_to(ctx.out(), "Unknown Packet Parse Error (0x{:x})",
+                            static_cast<uint8_t>(e));
+    }
+  }
+};
+
 template <>
 struct std::formatter<PacketHeader> : std::formatter<std::string_view> {
   constexpr auto parse(std::format_parse_context &ctx) { return ctx.begin(); }
@@ -34,6 +59,8 @@ struct std::formatter<MessageType> : std::formatter<std::string_view> {
       return std::format_to(ctx.out(), "Controllers Motors Info");
     case MessageType::ControllersMotorsRumbleMessage:
       return std::format_to(ctx.out(), "Controllers Motors Rumble");
+    case MessageType::ServerStatsMessage:
+      return std::format_to(ctx.out(), "Server Stats");
     default:
       return std::format_to(ctx.out(), "Unknown (0x{:x})",
                             static_cast<uint32_t>(t));
@@ -51,13 +78,23 @@ template <> struct std::formatter<Packet> : std::formatter<std::string_view> {
   }
 };
 
+template <>
+struct std::formatter<PacketView> : std::formatter<std::string_view> {
+  constexpr auto parse(std::format_parse_context &ctx) { return ctx.begin(); }
+
+  auto format(const PacketView &p, std::format_context &ctx) const {
+    return std::format_to(ctx.out(),
+                          "Packet{{Header: {}, Type: {}, Body: [{} Bytes]}}",
+                          p.header, p.type, p.body.size());
+  }
+};
+
 template <>
 struct std::formatter<ProtocolVersionRequest>
     : std::formatter<std::string_view> {
   constexpr auto parse(std::format_parse_context &ctx) { return ctx.begin(); }
 
-  auto format(const ProtocolVersionRequest &pvrq,
-              std::format_context &ctx) const {
+  auto format(const ProtocolVersionRequest &, std::format_context &ctx) const {
     return std::format_to(ctx.out(), "ProtocolVersionRequest{{}}");
   }
 };
@@ -181,9 +218,10 @@ struct std::formatter<ControllersInfoRequest>
 
   auto format(const ControllersInfoRequest &cirq,
               std::format_context &ctx) const {
+    auto ports = std::clamp<int32_t>(cirq.ports, 0, cirq.slots.size());
     return std::format_to(ctx.out(),
                           "ControllersInfoRequest{{Ports: {}, Slots: {}}}",
-                          cirq.ports, cirq.slots);
+                          cirq.ports, std::span(cirq.slots).first(ports));
   }
 };
 
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
+#include <span>
 #include <vector>
 
+#include "codec.hpp"
 #include "common/types.hpp"
 #include "utils.hpp"
 
@@ -10,7 +13,7 @@
 
 using byte = uint8_t;
 
-struct PacketHeader : public Serializable {
+struct PacketHeader {
   byte magic[4]; // Magic string — DSUS if it's message by server (you), DSUC
                  // if by client (cemuhook).
   uint16_t protocol; // Protocol version used in message. Currently 1001.
@@ -21,7 +24,13 @@ struct PacketHeader : public Serializable {
   uint32_t clientServerID; // Client or server ID who sent this packet. Should
   // stay the same on one run. Can be randomly
   // generated on startup.
-  SERIALIZABLE_IMPL()
+
+  static constexpr auto Fields =
+      codec::fields(&PacketHeader::magic, &PacketHeader::protocol,
+                    &PacketHeader::length, &PacketHeader::crc32,
+                    &PacketHeader::clientServerID);
+  // Reads the header off the front of a whole datagram
+  WIRE_FORMAT(Prefix)
 };
 
 enum class MessageType : uint32_t {
@@ -32,22 +41,46 @@ enum class MessageType : uint32_t {
   ControllersMotorsInfoMessage =
       0x110001, // (Unofficial) Information about controller motors
   ControllersMotorsRumbleMessage =
-      0x110002 // (Unofficial) Rumble controller motor
+      0x110002, // (Unofficial) Rumble controller motor
+  ServerStatsMessage = 0x120001 // (Unofficial, ProConDSU) Server counters
 };
 
-struct Packet : public Serializable {
+struct Packet {
   PacketHeader header;
   MessageType type; // Event type. Read below to learn possible ones.
   std::vector<uint8_t> body;
+
+  // Header plus message type, the body starts at this offset
+  static constexpr size_t HeaderSize =
+      PacketHeader::WireSize + sizeof(MessageType);
+
+  // Writes header and message type in front of a body that was already
+  // serialized in place at datagram[HeaderSize..], then fills in the length
+  // and CRC32. No allocation, the datagram can live on the stack
+  static void finalize(std::span<uint8_t> datagram, PacketHeader header,
+                       MessageType type);
   SERIALIZABLE_IMPL()
 };
 
-struct ProtocolVersionRequest : public Serializable {
+// Non-owning view of a received packet. The body points into the receive
+// buffer, so parsing a request doesn't allocate or copy
+struct PacketView {
+  PacketHeader header;
+  MessageType type;
+  std::span<const uint8_t> body;
+  DeserializeError deserialize(std::span<const uint8_t> buf,
+                               PacketOrigin origin = PacketOrigin::Client);
+};
+
+struct ProtocolVersionRequest {
   SERIALIZABLE_IMPL()
 };
-struct ProtocolVersionResponse : public Serializable {
+struct ProtocolVersionResponse {
   uint16_t version; // Maximal protocol version supported by your application.
-  SERIALIZABLE_IMPL()
+
+  static constexpr auto Fields =
+      codec::fields(&ProtocolVersionResponse::version);
+  WIRE_FORMAT(Exact)
 };
 
 enum class BatteryStatus : uint8_t {
@@ -79,7 +112,7 @@ enum class ConnectionType : uint8_t {
   ConnectionTypeBluetooth = 0x02
 };
 
-struct ControllerInfoShared : public Serializable {
+struct ControllerInfoShared {
   uint8_t slot; // Slot you're reporting about. Must be the same as byte value
                 // you read.
   ControllerState state; // Slot state: 0 if not connected, 1 if reserved (?), 2
@@ -92,22 +125,30 @@ struct ControllerInfoShared : public Serializable {
   byte macAddress[6]; // MAC address of device. It's used to detect same device
                       // between launches. Zero out if not applicable.
   BatteryStatus batteryState; // Battery status. See below for possible values.
-  SERIALIZABLE_IMPL()
+
+  static constexpr auto Fields = codec::fields(
+      &ControllerInfoShared::slot, &ControllerInfoShared::state,
+      &ControllerInfoShared::model, &ControllerInfoShared::connection,
+      &ControllerInfoShared::macAddress, &ControllerInfoShared::batteryState);
+  WIRE_FORMAT(Exact)
 };
 
-struct ControllersInfoRequest : public Serializable {
+struct ControllersInfoRequest {
   int32_t ports; // Amount of ports you should report about. Always less than 5.
-  std::vector<byte> slots; // Each byte represent number of slot you should
-                           // report about. Count of bytes here is determined by
-                           // value above. Each value is less than 4.
+  std::array<byte, 4> slots; // Each byte represent number of slot you should
+                             // report about. Count of bytes here is determined
+                             // by value above. Each value is less than 4.
   SERIALIZABLE_IMPL()
 };
-struct ControllerInfoResponse : public Serializable {
+struct ControllerInfoResponse {
   ControllerInfoShared info;
   byte _; // Zero byte (\0).
-  SERIALIZABLE_IMPL()
+
+  static constexpr auto Fields =
+      codec::fields(&ControllerInfoResponse::info, &ControllerInfoResponse::_);
+  WIRE_FORMAT(Exact)
 };
-struct ControllersInfoResponse : public Serializable {
+struct ControllersInfoResponse {
   std::vector<ControllerInfoResponse> info;
   SERIALIZABLE_IMPL()
 };
@@ -119,11 +160,13 @@ struct ControllerIdType {
     return *this;
   }
   constexpr operator uint8_t() const { return value; }
+
+  static constexpr auto Fields = codec::fields(&ControllerIdType::value);
 };
 constexpr ControllerIdType ControllerIdTypeSlot(1);
 constexpr ControllerIdType ControllerIdTypeMAC(2);
 
-struct ControllerIdentifier : public Serializable {
+struct ControllerIdentifier {
   ControllerIdType type; // Bitmask of actions you should take. Valid flags are
                          // 1 for slot-based registration, 2 for MAC-based
                          // registration, no bits (all set to 0) to subscribe to
@@ -131,12 +174,19 @@ struct ControllerIdentifier : public Serializable {
   uint8_t slot;
   byte mac[6]; // If MAC-based registration is requested, MAC of device to
                // report about.
-  SERIALIZABLE_IMPL()
+
+  static constexpr auto Fields =
+      codec::fields(&ControllerIdentifier::type, &ControllerIdentifier::slot,
+                    &ControllerIdentifier::mac);
+  WIRE_FORMAT(Prefix)
 };
 
-struct ControllersDataRequest : public Serializable {
+struct ControllersDataRequest {
   ControllerIdentifier controllerId;
-  SERIALIZABLE_IMPL()
+
+  static constexpr auto Fields =
+      codec::fields(&ControllersDataRequest::controllerId);
+  WIRE_FORMAT(Exact)
 };
 
 using GamePadButton = uint8_t;
@@ -162,29 +212,38 @@ constexpr GamePadButton ButtonL1 = 1 << 2;
 constexpr GamePadButton ButtonR2 = 1 << 1;
 constexpr GamePadButton ButtonL2 = 1 << 0;
 
-struct GamePadButtons : public Serializable {
+struct GamePadButtons {
   GamePadButton buttons1; // Bitmask D-Pad Left, D-Pad Down, D-Pad Right, D-Pad
                           // Up, Options (?), R3, L3, Share (?)
   GamePadButton buttons2; // Bitmask Y, B, A, X, R1, L1, R2, L2
-  SERIALIZABLE_IMPL()
+
+  static constexpr auto Fields =
+      codec::fields(&GamePadButtons::buttons1, &GamePadButtons::buttons2);
+  WIRE_FORMAT(Prefix)
 };
 
-struct Touch : public Serializable {
+struct Touch {
   bool active; // Is touch active (1 if active, else 0)
   uint8_t id;  // Touch id (should be the same for one continuous touch)
   uint16_t x;  // Touch X position
   uint16_t y;  // Touch Y position
-  SERIALIZABLE_IMPL()
+
+  static constexpr auto Fields =
+      codec::fields(&Touch::active, &Touch::id, &Touch::x, &Touch::y);
+  WIRE_FORMAT(Prefix)
 };
 
-struct Vectors3f : public Serializable {
+struct Vectors3f {
   float x;
   float y;
   float z;
-  SERIALIZABLE_IMPL()
+
+  static constexpr auto Fields =
+      codec::fields(&Vectors3f::x, &Vectors3f::y, &Vectors3f::z);
+  WIRE_FORMAT(Prefix)
 };
 
-struct ControllersDataResponse : public Serializable {
+struct ControllersDataResponse {
   ControllerInfoShared info;
   bool connected;     // Is controller connected (1 if connected, 0 if not)
   uint32_t packetNum; // Packet number (for this client)
@@ -213,23 +272,129 @@ struct ControllersDataResponse : public Serializable {
                       // with accelerometer (but not gyro only) changes
   Vectors3f accel;    // Accelerometer data in Gs
   Vectors3f gyro;     // Gyroscope data in degrees per second
-  SERIALIZABLE_IMPL()
+
+  using Self = ControllersDataResponse;
+  static constexpr auto Fields = codec::fields(
+      &Self::info, &Self::connected, &Self::packetNum, &Self::buttons,
+      &Self::home, &Self::touchButton, &Self::lStickX, &Self::lStickY,
+      &Self::rStickX, &Self::rStickY, &Self::aDPadL, &Self::aDPadD,
+      &Self::aDPadR, &Self::aDPadU, &Self::aY, &Self::aB, &Self::aA, &Self::aX,
+      &Self::aR1, &Self::aL1, &Self::aR2, &Self::aL2, &Self::touch1,
+      &Self::touch2, &Self::timestamp, &Self::accel, &Self::gyro);
+  WIRE_FORMAT(Exact)
 };
 
-struct ControllersMotorsRequest : public Serializable {
+static_assert(PacketHeader::WireSize == 16, "DSU header is 16 bytes");
+static_assert(ControllerInfoShared::WireSize == 11,
+              "Shared controller info must be 11 bytes");
+static_assert(ControllerIdentifier::WireSize == 8,
+              "Controller identifier must be 8 bytes");
+static_assert(Touch::WireSize == 6, "Touch must be 6 bytes");
+static_assert(ControllersDataResponse::WireSize == 80,
+              "ControllersDataResponse body must be 80 bytes");
+
+// Complete DSUS datagram carrying one ControllersDataResponse
+constexpr size_t ControllersDataPacketSize =
+    Packet::HeaderSize + ControllersDataResponse::WireSize;
+static_assert(ControllersDataPacketSize == 100);
+
+struct ControllersMotorsRequest {
   ControllerIdentifier controllerId;
-  SERIALIZABLE_IMPL()
+
+  static constexpr auto Fields =
+      codec::fields(&ControllersMotorsRequest::controllerId);
+  WIRE_FORMAT(Prefix)
 };
-struct ControllersMotorsResponse : public Serializable {
+struct ControllersMotorsResponse {
   ControllerInfoShared info;
   uint8_t motorCount; // Motor count - common values are 0 (no rumble
                       // support), 1 (single motor), and 2 (left/right motors)
-  SERIALIZABLE_IMPL()
+
+  static constexpr auto Fields =
+      codec::fields(&ControllersMotorsResponse::info,
+                    &ControllersMotorsResponse::motorCount);
+  WIRE_FORMAT(Exact)
 };
 
-struct ControllersMotorsRumbleRequest : public Serializable {
+struct ControllersMotorsRumbleRequest {
   ControllerIdentifier controllerId;
   uint8_t motorID;   // Motor id, 0~motor count-1
   uint8_t intensity; // Motor vibration intensity, 0~255 (0 means no vibration)
+
+  static constexpr auto Fields =
+      codec::fields(&ControllersMotorsRumbleRequest::controllerId,
+                    &ControllersMotorsRumbleRequest::motorID,
+                    &ControllersMotorsRumbleRequest::intensity);
+  WIRE_FORMAT(Exact)
+};
+
+// (Unofficial) Server counters, the request has no body. Everything is
+// cumulative since startup, pollers derive rates from two snapshots
+struct ServerStatsRequest {
+  SERIALIZABLE_IMPL()
+};
+
+struct ControllerStats {
+  bool connected;
+  uint64_t reports; // HID reports received from the controller
+  // Report to socket latency percentiles of pushed data packets
+  uint32_t latencyP50Us;
+  uint32_t latencyP99Us;
+  uint32_t latencyP999Us;
+
+  static constexpr auto Fields = codec::fields(
+      &ControllerStats::connected, &ControllerStats::reports,
+      &ControllerStats::latencyP50Us, &ControllerStats::latencyP99Us,
+      &ControllerStats::latencyP999Us);
+  WIRE_FORMAT(Exact)
+};
+
+struct ClientStats {
+  byte address[4];      // IPv4 address in network byte order
+  uint16_t port;        // UDP port
+  uint32_t packetsSent; // Data packets pushed to the client
+
+  static constexpr auto Fields = codec::fields(
+      &ClientStats::address, &ClientStats::port, &ClientStats::packetsSent);
+  WIRE_FORMAT(Exact)
+};
+
+struct ServerStatsResponse {
+  // DSU slots, every one is reported whether connected or not
+  static constexpr size_t SlotCount = 4;
+  // Longer client lists are cut, clientCount still has the total
+  static constexpr size_t MaxClients = 64;
+
+  uint64_t uptimeMs;
+  uint64_t datagramsSent;
+  uint64_t sendSyscalls;
+  // Inbound datagrams dropped, by reason
+  uint64_t rejectedLength;
+  uint64_t rejectedMagic;
+  uint64_t rejectedChecksum;
+  uint64_t rejectedParse;
+  uint64_t rejectedType;
+  uint64_t rejectedTableFull; // New clients turned away, table at capacity
+  uint64_t rejectedStats;     // Stats requests from addresses not allowed
+  uint64_t logDropped;   // Log records lost to a full ring
+  uint64_t traceDropped; // Latency samples lost to a full ring
+  uint32_t clientCount;  // Registered clients
+  std::array<ControllerStats, SlotCount> controllers;
+  std::vector<ClientStats> clients;
+
+  // Everything but the client list, which follows as ClientStats entries
+  using Self = ServerStatsResponse;
+  static constexpr auto Fields = codec::fields(
+      &Self::uptimeMs, &Self::datagramsSent, &Self::sendSyscalls,
+      &Self::rejectedLength, &Self::rejectedMagic, &Self::rejectedChecksum,
+      &Self::rejectedParse, &Self::rejectedType, &Self::rejectedTableFull,
+      &Self::rejectedStats, &Self::logDropped, &Self::traceDropped,
+      &Self::clientCount, &Self::controllers);
+  static constexpr size_t FixedSize = codec::wireSize(Fields);
+  static constexpr size_t MaxWireSize =
+      FixedSize + MaxClients * ClientStats::WireSize;
+  // Writes the body into out, which needs room for the listed clients, and
+  // returns its length
+  size_t serializeTo(std::span<uint8_t> out) const;
   SERIALIZABLE_IMPL()
 };
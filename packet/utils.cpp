@@ -1,43 +1,54 @@
 #include "utils.hpp"
 
+#include <array>
 #include <cstring>
-#include <format>
-
-template <> struct std::formatter<DeserializeError> {
-  constexpr auto parse(std::format_parse_context &ctx) { return ctx.begin(); }
-
-  auto format(const DeserializeError &e, std::format_context &ctx) const {
-    switch (e) {
-    case DeserializeError::None:
-      return std::format_to(ctx.out(), "No Error");
-    case DeserializeError::ErrInvalidPacket:
-      return std::format_to(ctx.out(), "Invalid Packet");
-    case DeserializeError::ErrInvalidLength:
-      return std::format_to(ctx.out(), "Invalid Length");
-    case DeserializeError::ErrParseError:
-      return std::format_to(ctx.out(), "Parse Error");
-    default:
-      return std::format_to(ctx.out(), "Unknown Packet Parse Error (0x{:x})",
-                            static_cast<uint8_t>(e));
-    }
-  }
-};
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
-DeserializeError isValidMessage(const ByteBuffer &buf) {
+DeserializeError isValidMessage(std::span<const uint8_t> buf,
+                                PacketOrigin origin) {
+  // Header (16 bytes) plus message type
   if (buf.size() < 20) {
     return DeserializeError::ErrInvalidLength;
   }
-  if (std::strncmp((char *)buf.data(), "DSUC", 4) != 0) {
+  const char *magic = origin == PacketOrigin::Client ? "DSUC" : "DSUS";
+  if (std::memcmp(buf.data(), magic, 4) != 0) {
     return DeserializeError::ErrInvalidPacket;
   }
 
-  // TODO: verify checksum
+  // Drop packets shorter than their header claims, trailing bytes past the
+  // declared length are ignored
+  uint16_t length;
+  std::memcpy(&length, buf.data() + 6, sizeof(length));
+  if (length < sizeof(uint32_t) || 16 + size_t{length} > buf.size()) {
+    return DeserializeError::ErrInvalidLength;
+  }
+
+  // CRC32 of the packet with the CRC field zeroed out
+  uint32_t expected;
+  std::memcpy(&expected, buf.data() + 8, sizeof(expected));
+  static constexpr uint8_t zeroes[4] = {};
+  Crc32 crc;
+  crc.update(buf.first(8));
+  crc.update(zeroes);
+  crc.update(buf.subspan(12, 4 + size_t{length}));
+  if (crc.value() != expected) {
+    return DeserializeError::ErrInvalidChecksum;
+  }
 
   return DeserializeError::None;
 }
 
-// Simple CRC32 implementation (IEEE polynomial)
-void init_crc32_table() {
+// CRC32 (IEEE polynomial, reflected)
+namespace {
+
+// tables[0] is the classic byte-at-a-time table, tables[k] advances a byte
+// through k more zero bytes so eight input bytes can be folded per step
+constexpr auto crc32Tables = [] {
+  std::array<std::array<uint32_t, 256>, 8> tables{};
   for (uint32_t i = 0; i < 256; i++) {
     uint32_t crc = i;
     for (int j = 0; j < 8; j++) {
@@ -47,20 +58,169 @@ void init_crc32_table() {
         crc >>= 1;
       }
     }
-    crc32_table[i] = crc;
+    tables[0][i] = crc;
+  }
+  for (size_t t = 1; t < tables.size(); t++) {
+    for (size_t i = 0; i < 256; i++) {
+      uint32_t prev = tables[t - 1][i];
+      tables[t][i] = (prev >> 8) ^ tables[0][prev & 0xFF];
+    }
   }
+  return tables;
+}();
+
+static_assert(crc32Tables[0][1] == 0x77073096);
+
+// One table lookup per byte, the original engine
+uint32_t crc32Bytewise(uint32_t crc, const uint8_t *data, size_t len) {
+  while (len--) {
+    crc = crc32Tables[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+  }
+  return crc;
 }
 
-uint32_t compute_crc32(const uint8_t *data, size_t len) {
-  static bool initialized = false;
-  if (!initialized) {
-    init_crc32_table();
-    initialized = true;
+uint32_t crc32SliceBy8(uint32_t crc, const uint8_t *data, size_t len) {
+  const auto &t = crc32Tables;
+  while (len >= 8) {
+    uint32_t lo, hi;
+    std::memcpy(&lo, data, sizeof(lo));
+    std::memcpy(&hi, data + 4, sizeof(hi));
+    lo ^= crc;
+    crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^
+          t[4][lo >> 24] ^ t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^
+          t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+    data += 8;
+    len -= 8;
+  }
+  while (len--) {
+    crc = t[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                              \
+    (defined(__GNUC__) || defined(__clang__))
+#define PROCONDSU_CRC32_PCLMUL 1
+
+// Folds 64-byte blocks with carry-less multiplication and finishes with a
+// Barrett reduction ("Fast CRC Computation for Generic Polynomials Using
+// PCLMULQDQ", Intel). Needs len >= 64 and a multiple of 16
+__attribute__((target("pclmul,sse4.1"))) uint32_t
+crc32FoldPclmul(uint32_t crc, const uint8_t *buf, size_t len) {
+  alignas(16) static const uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596};
+  alignas(16) static const uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e};
+  alignas(16) static const uint64_t k5k0[] = {0x0163cd6124, 0x0000000000};
+  alignas(16) static const uint64_t poly[] = {0x01db710641, 0x01f7011641};
+
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+  x1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + 0x00));
+  x2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + 0x10));
+  x3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + 0x20));
+  x4 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+  x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(k1k2));
+  buf += 64;
+  len -= 64;
+
+  // Fold four lanes in parallel
+  while (len >= 64) {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+    y5 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + 0x00));
+    y6 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + 0x10));
+    y7 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + 0x20));
+    y8 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + 0x30));
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+    buf += 64;
+    len -= 64;
+  }
+
+  // Fold the four lanes into one
+  x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(k3k4));
+  for (__m128i next : {x2, x3, x4}) {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, next), x5);
+  }
+
+  // Fold remaining 16-byte blocks
+  while (len >= 16) {
+    x2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf));
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    buf += 16;
+    len -= 16;
   }
 
-  uint32_t crc = 0xFFFFFFFF;
-  for (size_t i = 0; i < len; i++) {
-    crc = crc32_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  // Fold 128 bits down to 64
+  x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+  x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+  x1 = _mm_srli_si128(x1, 8);
+  x1 = _mm_xor_si128(x1, x2);
+  x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(k5k0));
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, x3);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  // Barrett reduction to 32 bits
+  x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(poly));
+  x2 = _mm_and_si128(x1, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+  x2 = _mm_and_si128(x2, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+
+uint32_t crc32Pclmul(uint32_t crc, const uint8_t *data, size_t len) {
+  if (len >= 64) {
+    size_t chunk = len & ~size_t{15};
+    crc = crc32FoldPclmul(crc, data, chunk);
+    data += chunk;
+    len -= chunk;
   }
-  return crc ^ 0xFFFFFFFF;
-}
\ No newline at end of file
+  return crc32SliceBy8(crc, data, len);
+}
+#endif
+
+} // namespace
+
+std::span<const Crc32Kernel> crc32Kernels() {
+  static const auto kernels = [] {
+    std::vector<Crc32Kernel> list = {{"bytewise", crc32Bytewise},
+                                     {"slice-by-8", crc32SliceBy8}};
+#ifdef PROCONDSU_CRC32_PCLMUL
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("pclmul") &&
+        __builtin_cpu_supports("sse4.1")) {
+      list.push_back({"pclmul", crc32Pclmul});
+    }
+#endif
+    return list;
+  }();
+  return kernels;
+}
+
+void Crc32::update(std::span<const uint8_t> data) {
+  static const auto kernel = crc32Kernels().back().update;
+  state = kernel(state, data.data(), data.size());
+}
+
+uint32_t compute_crc32(const uint8_t *data, size_t len) {
+  Crc32 crc;
+  crc.update({data, len});
+  return crc.value();
+}
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cassert>
 #include <cstring>
+#include <span>
 #include <stdexcept>
 
 #include "common/types.hpp"
@@ -9,27 +11,32 @@ enum class DeserializeError : uint8_t {
   None = 0,
   ErrInvalidPacket,
   ErrInvalidLength,
-  ErrParseError
+  ErrParseError,
+  ErrInvalidChecksum
 };
 
-DeserializeError isValidMessage(const ByteBuffer &buf);
+// Sender of a datagram, selects the expected magic: DSUC for clients, DSUS
+// for servers
+enum class PacketOrigin : uint8_t { Client, Server };
 
-struct Serializable {
-  virtual ~Serializable() = default;
-  virtual ByteBuffer serialize() const = 0;
-  virtual DeserializeError deserialize(const ByteBuffer &buf) = 0;
-};
+// Checks magic, header length and CRC32 of a datagram in a single pass
+// without allocating, so junk traffic is dropped before any parsing
+DeserializeError isValidMessage(std::span<const uint8_t> buf,
+                                PacketOrigin origin = PacketOrigin::Client);
+
+// Hand-written serialize/deserialize, for messages of variable length.
+// Fixed-size ones use WIRE_FORMAT from codec.hpp
 #define SERIALIZABLE_IMPL()                                                    \
-  ByteBuffer serialize() const override;                                       \
-  DeserializeError deserialize(const ByteBuffer &buf) override;
+  ByteBuffer serialize() const;                                                \
+  DeserializeError deserialize(std::span<const uint8_t> buf);
 
 // Binary read/write helpers for little-endian serialization
 class BinaryReader {
-  const ByteBuffer &buf;
+  std::span<const uint8_t> buf;
   size_t pos = 0;
 
 public:
-  BinaryReader(const ByteBuffer &b) : buf(b) {}
+  BinaryReader(std::span<const uint8_t> b) : buf(b) {}
 
   template <typename T> DeserializeError read(T &value) {
     if (pos + sizeof(T) > buf.size()) {
@@ -49,6 +56,14 @@ public:
     return DeserializeError::None;
   }
 
+  DeserializeError skip(size_t count) {
+    if (pos + count > buf.size()) {
+      return DeserializeError::ErrParseError;
+    }
+    pos += count;
+    return DeserializeError::None;
+  }
+
   size_t remaining() const { return buf.size() - pos; }
   size_t position() const { return pos; }
 };
@@ -69,6 +84,57 @@ public:
   ByteBuffer getBuffer() const { return buf; }
 };
 
-static uint32_t crc32_table[256];
-void init_crc32_table();
+// Writes fields straight into a caller-provided buffer. Callers size the
+// buffer from the compile-time WireSize of what they serialize, so writes are
+// only bounds-checked in debug builds
+class SpanWriter {
+  std::span<uint8_t> buf;
+  size_t pos = 0;
+
+public:
+  SpanWriter(std::span<uint8_t> b) : buf(b) {}
+
+  template <typename T> void write(const T &value) {
+    assert(pos + sizeof(T) <= buf.size());
+    std::memcpy(buf.data() + pos, &value, sizeof(T));
+    pos += sizeof(T);
+  }
+
+  void writeBytes(const uint8_t *src, size_t count) {
+    assert(pos + count <= buf.size());
+    std::memcpy(buf.data() + pos, src, count);
+    pos += count;
+  }
+
+  // Hands the next N bytes to a nested fixed-size serializer
+  template <size_t N> std::span<uint8_t, N> next() {
+    assert(pos + N <= buf.size());
+    std::span<uint8_t, N> out(buf.data() + pos, N);
+    pos += N;
+    return out;
+  }
+
+  size_t position() const { return pos; }
+};
+
+// Streaming CRC32 (IEEE polynomial), so a packet can be checksummed piece by
+// piece without concatenating it first. Picks at runtime between a
+// slice-by-8 table kernel and a PCLMULQDQ folding kernel
+class Crc32 {
+  uint32_t state = 0xFFFFFFFF;
+
+public:
+  void update(std::span<const uint8_t> data);
+  uint32_t value() const { return state ^ 0xFFFFFFFF; }
+};
+
 uint32_t compute_crc32(const uint8_t *data, size_t len);
+
+// The CRC32 kernels this build and CPU can run, for tests and benchmarks.
+// They take and return the raw register, without the initial and final
+// inversion. Crc32 uses the last one, the fastest
+struct Crc32Kernel {
+  const char *name;
+  uint32_t (*update)(uint32_t crc, const uint8_t *data, size_t len);
+};
+std::span<const Crc32Kernel> crc32Kernels();
@@ -0,0 +1,159 @@
+#include "pipeline_trace.hpp"
+
+#include <atomic>
+#include <format>
+#include <iterator>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+constexpr size_t RingSize = 4096; // Power of two
+
+// Single-producer single-consumer ring, one per recording thread
+struct Ring {
+  std::array<PipelineTrace::Sample, RingSize> samples;
+  std::atomic<uint64_t> head{0};
+  std::atomic<uint64_t> tail{0};
+};
+
+struct Registry {
+  std::mutex mutex;
+  // Rings of the live recording threads
+  std::vector<Ring *> rings;
+  std::array<std::array<LatencyHistogram, PipelineTrace::MaxControllers>,
+             PipelineTrace::StageCount>
+      histograms;
+  std::atomic<uint64_t> dropped{0};
+  std::atomic<bool> collectDue{false};
+};
+
+Registry &registry() {
+  static Registry instance;
+  return instance;
+}
+
+// Caller holds the registry mutex
+void drain(Registry &reg, Ring &ring) {
+  uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+  uint64_t head = ring.head.load(std::memory_order_acquire);
+  for (; tail != head; ++tail) {
+    const auto &sample = ring.samples[tail & (RingSize - 1)];
+    reg.histograms[static_cast<size_t>(sample.stage)][sample.controller]
+        .record(std::chrono::nanoseconds(sample.ns));
+  }
+  ring.tail.store(tail, std::memory_order_release);
+}
+
+// Registers the ring of a thread on first use. When the thread exits its
+// samples are folded in and the ring goes away, so hot-plug threads don't
+// leave rings behind
+class ThreadRing {
+public:
+  ThreadRing() {
+    auto &reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    reg.rings.push_back(&ring);
+  }
+
+  ~ThreadRing() {
+    auto &reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    drain(reg, ring);
+    std::erase(reg.rings, &ring);
+  }
+
+  Ring ring;
+};
+
+Ring &threadRing() {
+  thread_local ThreadRing holder;
+  return holder.ring;
+}
+
+} // namespace
+
+void PipelineTrace::push(const Sample &sample) {
+  auto &ring = threadRing();
+  uint64_t head = ring.head.load(std::memory_order_relaxed);
+  uint64_t used = head - ring.tail.load(std::memory_order_acquire);
+  if (used == RingSize) {
+    registry().dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  ring.samples[head & (RingSize - 1)] = sample;
+  ring.head.store(head + 1, std::memory_order_release);
+  if (used + 1 == RingSize / 2) {
+    registry().collectDue.store(true, std::memory_order_relaxed);
+  }
+}
+
+bool PipelineTrace::collectDue() {
+  auto &reg = registry();
+  return reg.collectDue.load(std::memory_order_relaxed) &&
+         reg.collectDue.exchange(false, std::memory_order_relaxed);
+}
+
+void PipelineTrace::collect() {
+  auto &reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  for (auto *ring : reg.rings) {
+    drain(reg, *ring);
+  }
+}
+
+const LatencyHistogram &PipelineTrace::histogram(Stage stage,
+                                                 size_t controller) {
+  return registry().histograms[static_cast<size_t>(stage)][controller];
+}
+
+std::string_view PipelineTrace::stageName(Stage stage) {
+  switch (stage) {
+  case Stage::Callback:
+    return "callback";
+  case Stage::Dispatch:
+    return "dispatch";
+  case Stage::Build:
+    return "build";
+  case Stage::Serialize:
+    return "serialize";
+  case Stage::Send:
+    return "send";
+  }
+  return "unknown";
+}
+
+uint64_t PipelineTrace::dropped() {
+  return registry().dropped.load(std::memory_order_relaxed);
+}
+
+std::string PipelineTrace::exportJson() {
+  collect();
+
+  // Hold the registry so a concurrent collect() can't update the histograms
+  // while they are rendered
+  auto &reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  auto micros = [](std::chrono::nanoseconds ns) { return ns.count() / 1000.0; };
+  std::string json = "{\"stages\": [";
+  bool first = true;
+  for (size_t s = 0; s < StageCount; ++s) {
+    auto stage = static_cast<Stage>(s);
+    for (size_t c = 0; c < MaxControllers; ++c) {
+      const auto &hist = reg.histograms[s][c];
+      if (hist.count() == 0) {
+        continue;
+      }
+      std::format_to(std::back_inserter(json),
+                     "{}{{\"stage\": \"{}\", \"controller\": {}, \"count\": "
+                     "{}, \"p50_us\": {:.1f}, \"p99_us\": {:.1f}, "
+                     "\"p999_us\": {:.1f}}}",
+                     first ? "" : ", ", stageName(stage), c, hist.count(),
+                     micros(hist.percentile(50)), micros(hist.percentile(99)),
+                     micros(hist.percentile(99.9)));
+      first = false;
+    }
+  }
+  std::format_to(std::back_inserter(json), "], \"dropped\": {}}}", dropped());
+  return json;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "common/latency_histogram.hpp"
+
+// Always-on latency breakdown of the input pipeline. Every stage records how
+// long after the HID report timestamp it was reached, into a ring owned by
+// the recording thread (a clock read and a 16-byte store, no locks or shared
+// cache lines). collect() folds the rings into per-stage, per-controller
+// histograms. Timestamps are steady_clock, like MappedInput's
+class PipelineTrace {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  enum class Stage : uint8_t {
+    Callback,  // Report stored by ControllerManager
+    Dispatch,  // Picked up by the dispatcher
+    Build,     // ControllersDataResponse built
+    Serialize, // Datagrams of one motion frame serialized for every client
+    Send,      // Handed to the socket
+  };
+  static constexpr size_t StageCount = 5;
+  static constexpr size_t MaxControllers = 4;
+
+  static void record(Stage stage, size_t controller,
+                     Clock::time_point report, Clock::time_point now) {
+    if (controller < MaxControllers) {
+      auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now -
+                                                                     report);
+      push({ns.count() > 0 ? static_cast<uint64_t>(ns.count()) : 0,
+            static_cast<uint8_t>(controller), stage});
+    }
+  }
+  static void record(Stage stage, size_t controller,
+                     Clock::time_point report) {
+    record(stage, controller, report, Clock::now());
+  }
+
+  // Moves every buffered sample into the histograms. Safe from any thread
+  static void collect();
+  // True once since a ring filled up to half, collect() soon to keep it
+  // from dropping samples
+  static bool collectDue();
+
+  // Buckets are atomic, other threads may read while collect() runs and see
+  // a few samples less
+  static const LatencyHistogram &histogram(Stage stage, size_t controller);
+  static std::string_view stageName(Stage stage);
+  // Samples lost to full rings
+  static uint64_t dropped();
+
+  // Collects, then renders p50/p99/p99.9 in microseconds of every stage and
+  // controller with samples as JSON
+  static std::string exportJson();
+
+  struct Sample {
+    uint64_t ns;
+    uint8_t controller;
+    Stage stage;
+  };
+
+private:
+  static void push(const Sample &sample);
+};
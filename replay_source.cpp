@@ -0,0 +1,58 @@
+#include "replay_source.hpp"
+
+#include <format>
+#include <mutex>
+#include <print>
+
+ReplaySource::ReplaySource(std::shared_ptr<const InputLog> log, size_t slot,
+                           bool realtime,
+                           std::chrono::steady_clock::time_point start)
+    : log(std::move(log)), slot(slot), realtime(realtime), startTime(start) {}
+
+ReplaySource::~ReplaySource() {
+  thread.request_stop();
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+void ReplaySource::setInputCallback(InputCallback callback) {
+  inputCallback = std::move(callback);
+}
+
+void ReplaySource::start() {
+  thread = std::jthread(std::bind_front(&ReplaySource::run, this));
+}
+
+std::string ReplaySource::name() const {
+  return std::format("replay #{}{}", slot, realtime ? "" : " (fast)");
+}
+
+void ReplaySource::run(std::stop_token stoken) {
+  size_t replayed = 0;
+  for (const auto &record : log->records()) {
+    if (stoken.stop_requested()) {
+      return;
+    }
+    if (record.slot != slot) {
+      continue;
+    }
+    if (realtime) {
+      // Interruptible wait, recorded sessions can have long idle gaps
+      std::unique_lock<std::mutex> lock(waitMutex);
+      auto due = startTime + std::chrono::nanoseconds(record.offsetNs);
+      if (waitCv.wait_until(lock, stoken, due, [] { return false; }) ||
+          stoken.stop_requested()) {
+        return;
+      }
+    }
+
+    auto input = record.input;
+    input.timestamp = InputClock::now();
+    if (inputCallback) {
+      inputCallback(input);
+    }
+    ++replayed;
+  }
+  std::println("Replay of slot {} finished after {} reports", slot, replayed);
+}
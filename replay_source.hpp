@@ -0,0 +1,37 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "input_log.hpp"
+#include "input_source.hpp"
+
+// Feeds one slot of a recorded log back as a controller. Reports keep their
+// recorded spacing relative to a start time shared by all slots, or are
+// replayed back to back when realtime is off. Timestamps are rewritten to
+// the replay clock so latency measurements stay meaningful
+class ReplaySource : public InputSource {
+public:
+  ReplaySource(std::shared_ptr<const InputLog> log, size_t slot, bool realtime,
+               std::chrono::steady_clock::time_point start);
+  ~ReplaySource() override;
+
+  void setInputCallback(InputCallback callback) override;
+  void start() override;
+  std::string name() const override;
+
+private:
+  void run(std::stop_token stoken);
+
+  std::shared_ptr<const InputLog> log;
+  size_t slot;
+  bool realtime;
+  std::chrono::steady_clock::time_point startTime;
+  InputCallback inputCallback;
+  std::mutex waitMutex;
+  std::condition_variable_any waitCv;
+  std::jthread thread;
+};
@@ -0,0 +1,115 @@
+#include "rumble_dispatcher.hpp"
+
+namespace {
+
+constexpr uint32_t StopBit = 1u << 31;
+
+using BasicRumble = ProControllerHid::ProController::BasicRumble;
+
+struct RumbleLevel {
+  uint8_t lowAmp;
+  uint8_t highAmp;
+};
+
+// DSU intensity (0-255) to HID amplitudes. The motors barely move at low
+// amplitudes and saturate early, so the curve is a square root with a
+// floor. The high band carries half the amplitude so strong effects keep a
+// buzz on top of the rumble
+constexpr auto RumbleLevels = [] {
+  std::array<RumbleLevel, 256> levels{};
+  for (size_t i = 1; i < levels.size(); ++i) {
+    // Integer square root of i * 255, i.e. 255 * sqrt(i / 255)
+    uint32_t target = static_cast<uint32_t>(i) * 255;
+    uint32_t root = 0;
+    while ((root + 1) * (root + 1) <= target) {
+      ++root;
+    }
+    uint32_t amp = 0x10 + root * (0xff - 0x10) / 255;
+    levels[i] = {static_cast<uint8_t>(amp), static_cast<uint8_t>(amp / 2)};
+  }
+  return levels;
+}();
+
+// Keep the library's default band frequencies, only amplitude follows the
+// requested intensity
+constexpr uint8_t LowFreq = 0x80;
+constexpr uint8_t HighFreq = 0x80;
+
+BasicRumble buildRumble(uint8_t left, uint8_t right) {
+  BasicRumble rumble;
+  rumble.Left.Low = {LowFreq, RumbleLevels[left].lowAmp};
+  rumble.Left.High = {HighFreq, RumbleLevels[left].highAmp};
+  rumble.Right.Low = {LowFreq, RumbleLevels[right].lowAmp};
+  rumble.Right.High = {HighFreq, RumbleLevels[right].highAmp};
+  return rumble;
+}
+
+} // namespace
+
+RumbleDispatcher::RumbleDispatcher(ControllerManager &controllerManager,
+                                   std::chrono::milliseconds interval)
+    : controllerManager(controllerManager), interval(interval) {
+  thread = std::jthread(std::bind_front(&RumbleDispatcher::run, this));
+}
+
+RumbleDispatcher::~RumbleDispatcher() { stop(); }
+
+void RumbleDispatcher::stop() {
+  thread.request_stop();
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+void RumbleDispatcher::post(size_t controller_index, uint8_t motor,
+                            uint8_t intensity) {
+  if (controller_index >= intensities.size() || motor >= MotorCount) {
+    return;
+  }
+  // Latest wins, the thread reads whatever is there when it gets to it
+  intensities[controller_index][motor].store(intensity,
+                                             std::memory_order_relaxed);
+  uint32_t bit = 1u << controller_index;
+  if ((pending.fetch_or(bit, std::memory_order_release) & bit) == 0) {
+    pending.notify_one();
+  }
+}
+
+void RumbleDispatcher::run(std::stop_token stoken) {
+  std::stop_callback wake(stoken, [this] {
+    pending.fetch_or(StopBit, std::memory_order_release);
+    pending.notify_one();
+  });
+
+  auto lastFlush = std::chrono::steady_clock::time_point{};
+  while (true) {
+    pending.wait(0, std::memory_order_acquire);
+    if (pending.load(std::memory_order_relaxed) & StopBit) {
+      break;
+    }
+
+    // Bound the HID output rate, anything posted meanwhile is coalesced
+    // into this flush
+    std::this_thread::sleep_until(lastFlush + interval);
+    uint32_t changed = pending.exchange(0, std::memory_order_acquire);
+    if (changed & StopBit) {
+      break;
+    }
+    lastFlush = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; changed != 0; ++i, changed >>= 1) {
+      if (changed & 1) {
+        controllerManager.setRumble(
+            i, buildRumble(intensities[i][0].load(std::memory_order_relaxed),
+                           intensities[i][1].load(std::memory_order_relaxed)));
+      }
+    }
+  }
+
+  // Don't leave motors running after shutdown
+  for (size_t i = 0; i < intensities.size(); ++i) {
+    if (intensities[i][0] != 0 || intensities[i][1] != 0) {
+      controllerManager.setRumble(i, buildRumble(0, 0));
+    }
+  }
+}
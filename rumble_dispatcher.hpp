@@ -0,0 +1,46 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#include "controller_manager.hpp"
+
+// Forwards DSU rumble requests to the controllers. Requests only overwrite a
+// per-controller, per-motor mailbox, so a client spamming rumble never waits
+// on HID I/O. A dedicated thread sends the newest intensities of changed
+// controllers at most once per interval and drops everything in between
+class RumbleDispatcher {
+public:
+  // Pro Controllers report two motors, left (0) and right (1)
+  static constexpr size_t MotorCount = 2;
+
+  explicit RumbleDispatcher(
+      ControllerManager &controllerManager,
+      std::chrono::milliseconds interval = std::chrono::milliseconds(25));
+  ~RumbleDispatcher();
+
+  // Lock-free, callable from any thread
+  void post(size_t controller_index, uint8_t motor, uint8_t intensity);
+
+  // Silences every motor left running and stops the thread, later posts are
+  // ignored
+  void stop();
+
+private:
+  void run(std::stop_token stoken);
+
+  ControllerManager &controllerManager;
+  std::chrono::milliseconds interval;
+
+  std::array<std::array<std::atomic<uint8_t>, MotorCount>,
+             ControllerManager::MaxControllers>
+      intensities{};
+  // Bit per controller with a mailbox change not yet sent, bit 31 wakes the
+  // thread for shutdown
+  std::atomic<uint32_t> pending{0};
+
+  std::jthread thread;
+};
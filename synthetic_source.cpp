@@ -0,0 +1,99 @@
+#include "synthetic_source.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <format>
+
+namespace {
+
+constexpr double Pi = 3.14159265358979323846;
+
+// Buttons the pattern walks through, one every ButtonPeriod seconds
+constexpr uint32_t ButtonMask = 0x00ff3fff;
+constexpr double ButtonPeriod = 0.25;
+
+} // namespace
+
+SyntheticSource::SyntheticSource(size_t slot, unsigned rate)
+    : slot(slot), rate(std::clamp(rate, 1u, MaxRate)) {}
+
+SyntheticSource::~SyntheticSource() {
+  thread.request_stop();
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+void SyntheticSource::setInputCallback(InputCallback callback) {
+  inputCallback = std::move(callback);
+}
+
+void SyntheticSource::start() {
+  thread = std::jthread(std::bind_front(&SyntheticSource::run, this));
+}
+
+std::string SyntheticSource::name() const {
+  return std::format("synthetic #{} @ {} Hz", slot, rate);
+}
+
+ProControllerHid::InputStatus SyntheticSource::generate(double t,
+                                                        size_t slot) {
+  ProControllerHid::InputStatus status{};
+  double phase = slot * Pi / 2;
+
+  // Walk one bit at a time through the mapped buttons
+  uint32_t step = static_cast<uint32_t>(t / ButtonPeriod) + slot * 5;
+  uint32_t mask = ButtonMask;
+  for (uint32_t i = step % std::popcount(ButtonMask); i > 0; --i) {
+    mask &= mask - 1;
+  }
+  uint32_t bits = mask & -mask;
+  std::memcpy(&status.Buttons, &bits, sizeof(bits));
+
+  // Left stick circles once per second, right stick traces a figure eight
+  double a = 2 * Pi * t + phase;
+  status.LeftStick = {static_cast<float>(0.8 * std::cos(a)),
+                      static_cast<float>(0.8 * std::sin(a))};
+  status.RightStick = {static_cast<float>(0.8 * std::sin(a / 2)),
+                       static_cast<float>(0.8 * std::sin(a))};
+
+  // Gravity rotating around the Y axis at a quarter turn per second, with the
+  // matching angular rate in deg/s
+  double g = Pi / 2 * t + phase;
+  status.HasSensorStatus = true;
+  for (auto &sensor : status.Sensors) {
+    sensor.Accelerometer = {static_cast<float>(std::sin(g)), 0.0f,
+                            static_cast<float>(-std::cos(g))};
+    sensor.Gyroscope = {0.0f, 90.0f, 0.0f};
+  }
+
+  status.Timestamp = ProControllerHid::Clock::now();
+  return status;
+}
+
+void SyntheticSource::run(std::stop_token stoken) {
+  using Clock = std::chrono::steady_clock;
+  auto period = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(1.0 / rate));
+  auto begin = Clock::now();
+  auto next = begin;
+
+  while (!stoken.stop_requested()) {
+    auto now = Clock::now();
+    double t = std::chrono::duration<double>(now - begin).count();
+    if (inputCallback) {
+      inputCallback(mapInput(generate(t, slot)));
+    }
+
+    // Fixed schedule so the average rate holds even when a tick runs late,
+    // but don't burst to catch up after a long stall
+    next += period;
+    if (next < now) {
+      next = now + period;
+    }
+    std::this_thread::sleep_until(next);
+  }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <thread>
+
+#include "input_source.hpp"
+
+// Virtual controller producing a scripted input stream: a walking button
+// pattern, sticks tracing circles and a slowly rotating IMU. Every slot gets
+// a different phase so multiple instances are distinguishable
+class SyntheticSource : public InputSource {
+public:
+  static constexpr unsigned MaxRate = 1000;
+
+  // rate is in reports per second, clamped to [1, MaxRate]
+  SyntheticSource(size_t slot, unsigned rate);
+  ~SyntheticSource() override;
+
+  void setInputCallback(InputCallback callback) override;
+  void start() override;
+  std::string name() const override;
+
+  // The scripted state t seconds into the stream
+  static ProControllerHid::InputStatus generate(double t, size_t slot);
+
+private:
+  void run(std::stop_token stoken);
+
+  size_t slot;
+  unsigned rate;
+  InputCallback inputCallback;
+  std::jthread thread;
+};
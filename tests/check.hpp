@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdlib>
+#include <iostream>
+
+// Minimal assertions for the test executables: a failed CHECK reports the
+// expression and keeps going, main returns test::result() so CTest sees the
+// failure
+namespace test {
+
+inline int &failures() {
+  static int count = 0;
+  return count;
+}
+
+inline int result() {
+  if (failures() != 0) {
+    std::cerr << failures() << " check(s) failed\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+} // namespace test
+
+#define CHECK(expr)                                                            \
+  do {                                                                         \
+    if (!(expr)) {                                                             \
+      std::cerr << __FILE__ << ':' << __LINE__ << ": CHECK(" #expr             \
+                << ") failed\n";                                               \
+      ++test::failures();                                                      \
+    }                                                                          \
+  } while (false)
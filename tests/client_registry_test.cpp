@@ -0,0 +1,100 @@
+// ClientRegistry against a std::map model: random registrations, renewals
+// and expiry passes on a simulated clock. Every client must be evicted no
+// earlier than its timeout and no later than one wheel tick after it.
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <random>
+
+#include "check.hpp"
+#include "common/client_registry.hpp"
+
+namespace {
+
+struct Client {
+  uint64_t id = 0;
+};
+
+using Registry = ClientRegistry<Client, 256>;
+using Clock = Registry::Clock;
+
+Connection connection(uint32_t n) {
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(0x0a000000 | (n >> 8));
+  addr.sin_port = htons(static_cast<uint16_t>(40000 + (n & 0xff)));
+  return Connection(addr);
+}
+
+// One client, renewed never, polled every few ms from different phases
+// relative to the wheel ticks
+void checkSingleDeadline() {
+  const auto timeout = std::chrono::seconds(5);
+  for (int phase = 0; phase < 50; ++phase) {
+    Registry registry(timeout);
+    auto start = Clock::time_point(std::chrono::hours(1)) +
+                 std::chrono::milliseconds(phase * 7);
+    registry.touch(connection(1), start);
+
+    Clock::time_point evictedAt{};
+    for (auto now = start; now < start + 3 * timeout;
+         now += std::chrono::milliseconds(3)) {
+      registry.expire(now, [&](const Client &) { evictedAt = now; });
+      if (evictedAt != Clock::time_point{}) {
+        break;
+      }
+    }
+    CHECK(evictedAt >= start + timeout);
+    CHECK(evictedAt <= start + timeout + Registry::WheelTick);
+    CHECK(registry.size() == 0);
+  }
+}
+
+void checkAgainstModel() {
+  const auto timeout = std::chrono::milliseconds(1300);
+  Registry registry(timeout);
+  std::map<uint32_t, Clock::time_point> model;
+  std::mt19937 rng(7);
+
+  auto now = Clock::time_point(std::chrono::hours(2));
+  for (int step = 0; step < 200000; ++step) {
+    now += std::chrono::microseconds(rng() % 20000);
+    registry.expire(now, [&](const Client &client) {
+      auto it = model.find(static_cast<uint32_t>(client.id));
+      CHECK(it != model.end());
+      if (it != model.end()) {
+        CHECK(now - it->second >= timeout);
+        model.erase(it);
+      }
+    });
+    // Whatever the wheel kept is not overdue by more than a tick
+    for (const auto &[id, lastSeen] : model) {
+      CHECK(now - lastSeen <= timeout + Registry::WheelTick);
+    }
+
+    uint32_t id = rng() % 400;
+    auto [client, inserted] = registry.touch(connection(id), now);
+    bool known = model.contains(id);
+    if (!client) {
+      CHECK(!known && model.size() == 256);
+      continue;
+    }
+    CHECK(inserted == !known);
+    if (inserted) {
+      client->id = id;
+    }
+    CHECK(client->id == id);
+    model[id] = now;
+    CHECK(registry.size() == model.size());
+    CHECK(registry.find(connection(id)) == client);
+  }
+}
+
+} // namespace
+
+int main() {
+  checkSingleDeadline();
+  checkAgainstModel();
+  return test::result();
+}
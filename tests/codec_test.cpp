@@ -0,0 +1,202 @@
+// Round-trips every wire struct through the codec: random field values
+// serialize to WireSize bytes, serializeTo writes the same bytes in place,
+// and deserializing them gives a value that serializes back identically.
+// Length checks follow each struct's Prefix or Exact match, and the
+// ControllersDataResponse layout is pinned to the DSU offsets.
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "check.hpp"
+#include "packet/packet.hpp"
+
+namespace {
+
+using Rng = std::mt19937_64;
+
+template <typename T> void randomize(T &value, Rng &rng);
+
+template <typename T, size_t... I>
+void randomizeFields(T &value, Rng &rng, std::index_sequence<I...>) {
+  (randomize(value.*std::get<I>(T::Fields.members), rng), ...);
+}
+
+// Any bit pattern for numbers and enums, 0 or 1 for bool, the way the wire
+// carries them
+template <typename T> void randomize(T &value, Rng &rng) {
+  if constexpr (std::is_same_v<T, bool>) {
+    value = rng() & 1;
+  } else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>) {
+    uint64_t bits = rng();
+    std::memcpy(&value, &bits, sizeof(T));
+  } else if constexpr (codec::ArrayTraits<T>::IsArray) {
+    for (auto &element : value) {
+      randomize(element, rng);
+    }
+  } else {
+    constexpr size_t Count = std::tuple_size_v<decltype(T::Fields.members)>;
+    randomizeFields(value, rng, std::make_index_sequence<Count>());
+  }
+}
+
+bool same(std::span<const uint8_t> a, std::span<const uint8_t> b) {
+  return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size()) == 0;
+}
+
+template <typename T, codec::Match M> void checkRoundTrip(Rng &rng) {
+  for (int round = 0; round < 1000; ++round) {
+    T value{};
+    randomize(value, rng);
+
+    ByteBuffer bytes = value.serialize();
+    CHECK(bytes.size() == T::WireSize);
+    std::array<uint8_t, T::WireSize> inPlace;
+    value.serializeTo(inPlace);
+    CHECK(same(bytes, inPlace));
+
+    T decoded{};
+    CHECK(decoded.deserialize(bytes) == DeserializeError::None);
+    CHECK(same(decoded.serialize(), bytes));
+
+    // A byte short never decodes, a byte long only for Prefix structs
+    T other{};
+    CHECK(other.deserialize(std::span(bytes).first(T::WireSize - 1)) ==
+          DeserializeError::ErrInvalidLength);
+    bytes.push_back(static_cast<uint8_t>(rng()));
+    auto expected = M == codec::Match::Prefix
+                        ? DeserializeError::None
+                        : DeserializeError::ErrInvalidLength;
+    CHECK(other.deserialize(bytes) == expected);
+  }
+}
+
+// Wire bool is 0 or 1 whatever the byte was
+void checkBoolDecoding() {
+  Touch touch{};
+  std::array<uint8_t, Touch::WireSize> bytes{0x80, 7, 1, 0, 2, 0};
+  CHECK(touch.deserialize(bytes) == DeserializeError::None);
+  CHECK(touch.active && touch.id == 7 && touch.x == 1 && touch.y == 2);
+  CHECK(touch.serialize()[0] == 1);
+}
+
+void checkDataLayout() {
+  using Offsets = decltype(codec::FieldOffsets<ControllersDataResponse>);
+  const Offsets &offsets = codec::FieldOffsets<ControllersDataResponse>;
+  // info, connected, packetNum, buttons, home, touchButton, lStickX
+  CHECK(offsets[0] == 0 && offsets[1] == 11 && offsets[2] == 12);
+  CHECK(offsets[3] == 16 && offsets[4] == 18 && offsets[5] == 19);
+  CHECK(offsets[6] == 20);
+  // touch1, touch2, timestamp, accel, gyro
+  CHECK(offsets[22] == 36 && offsets[23] == 42 && offsets[24] == 48);
+  CHECK(offsets[25] == 56 && offsets[26] == 68);
+
+  ControllersDataResponse cdrs{};
+  cdrs.packetNum = 0x04030201;
+  cdrs.timestamp = 0x0807060504030201;
+  cdrs.gyro.z = 1.0f;
+  auto bytes = cdrs.serialize();
+  CHECK(bytes[12] == 0x01 && bytes[15] == 0x04);
+  CHECK(bytes[48] == 0x01 && bytes[55] == 0x08);
+  CHECK(bytes[79] == 0x3F && bytes[78] == 0x80);
+}
+
+void checkControllersInfo(Rng &rng) {
+  for (int32_t ports = 0; ports <= 4; ++ports) {
+    ControllersInfoRequest request{};
+    request.ports = ports;
+    for (int32_t i = 0; i < ports; ++i) {
+      request.slots[i] = static_cast<uint8_t>(rng() & 3);
+    }
+    auto bytes = request.serialize();
+    CHECK(bytes.size() == 4 + static_cast<size_t>(ports));
+    ControllersInfoRequest decoded{};
+    CHECK(decoded.deserialize(bytes) == DeserializeError::None);
+    CHECK(decoded.ports == ports && decoded.slots == request.slots);
+    CHECK(same(decoded.serialize(), bytes));
+  }
+
+  for (size_t count = 0; count <= 4; ++count) {
+    ControllersInfoResponse response;
+    response.info.resize(count);
+    for (auto &entry : response.info) {
+      randomize(entry, rng);
+    }
+    auto bytes = response.serialize();
+    CHECK(bytes.size() == count * ControllerInfoResponse::WireSize);
+    ControllersInfoResponse decoded;
+    CHECK(decoded.deserialize(bytes) == DeserializeError::None);
+    CHECK(decoded.info.size() == count);
+    CHECK(same(decoded.serialize(), bytes));
+  }
+}
+
+void checkServerStats(Rng &rng) {
+  for (size_t count : {size_t{0}, size_t{1}, size_t{5},
+                       ServerStatsResponse::MaxClients}) {
+    ServerStatsResponse stats{};
+    randomize(stats, rng);
+    stats.clients.resize(count);
+    for (auto &client : stats.clients) {
+      randomize(client, rng);
+    }
+    auto bytes = stats.serialize();
+    CHECK(bytes.size() ==
+          ServerStatsResponse::FixedSize + count * ClientStats::WireSize);
+    ServerStatsResponse decoded{};
+    CHECK(decoded.deserialize(bytes) == DeserializeError::None);
+    CHECK(decoded.clients.size() == count);
+    CHECK(same(decoded.serialize(), bytes));
+  }
+
+  // Rejection counters follow rejectedType in order
+  ServerStatsResponse counters{};
+  counters.rejectedType = 1;
+  counters.rejectedTableFull = 2;
+  counters.rejectedStats = 3;
+  auto counterBytes = counters.serialize();
+  CHECK(counterBytes[56] == 1 && counterBytes[64] == 2 &&
+        counterBytes[72] == 3);
+  ServerStatsResponse decodedCounters{};
+  CHECK(decodedCounters.deserialize(counterBytes) == DeserializeError::None);
+  CHECK(decodedCounters.rejectedTableFull == 2 &&
+        decodedCounters.rejectedStats == 3);
+
+  // Lists past MaxClients are cut on the wire
+  ServerStatsResponse stats{};
+  stats.clients.resize(ServerStatsResponse::MaxClients + 3);
+  CHECK(stats.serialize().size() == ServerStatsResponse::MaxWireSize);
+}
+
+} // namespace
+
+int main() {
+  Rng rng(2024);
+  using codec::Match;
+  checkRoundTrip<PacketHeader, Match::Prefix>(rng);
+  checkRoundTrip<ProtocolVersionResponse, Match::Exact>(rng);
+  checkRoundTrip<ControllerInfoShared, Match::Exact>(rng);
+  checkRoundTrip<ControllerInfoResponse, Match::Exact>(rng);
+  checkRoundTrip<ControllerIdentifier, Match::Prefix>(rng);
+  checkRoundTrip<ControllersDataRequest, Match::Exact>(rng);
+  checkRoundTrip<GamePadButtons, Match::Prefix>(rng);
+  checkRoundTrip<Touch, Match::Prefix>(rng);
+  checkRoundTrip<Vectors3f, Match::Prefix>(rng);
+  checkRoundTrip<ControllersDataResponse, Match::Exact>(rng);
+  checkRoundTrip<ControllersMotorsRequest, Match::Prefix>(rng);
+  checkRoundTrip<ControllersMotorsResponse, Match::Exact>(rng);
+  checkRoundTrip<ControllersMotorsRumbleRequest, Match::Exact>(rng);
+  checkRoundTrip<ControllerStats, Match::Exact>(rng);
+  checkRoundTrip<ClientStats, Match::Exact>(rng);
+  checkBoolDecoding();
+  checkDataLayout();
+  checkControllersInfo(rng);
+  checkServerStats(rng);
+  return test::result();
+}
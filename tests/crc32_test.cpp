@@ -0,0 +1,122 @@
+// Checks every CRC32 kernel against a bit-at-a-time reference over random
+// lengths and alignments, the streaming Crc32 against one-shot results,
+// and the datagram checks built on top of it.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <span>
+#include <vector>
+
+#include "check.hpp"
+#include "packet/packet.hpp"
+
+namespace {
+
+// Straight from the definition: reflected IEEE polynomial, one bit per step
+uint32_t referenceCrc32(std::span<const uint8_t> data) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (uint8_t byte : data) {
+    crc ^= byte;
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return crc ^ 0xFFFFFFFF;
+}
+
+void checkKnownVector() {
+  const char *text = "123456789";
+  auto data = reinterpret_cast<const uint8_t *>(text);
+  CHECK(referenceCrc32({data, 9}) == 0xCBF43926);
+  CHECK(compute_crc32(data, 9) == 0xCBF43926);
+  CHECK(compute_crc32(data, 0) == 0);
+}
+
+// Lengths cover the empty buffer, every tail size around the 8-byte slices
+// and 64-byte folds, and random sizes up to a few KB, each at every offset
+// within a 16-byte block
+void checkKernels(std::mt19937 &rng) {
+  std::vector<uint8_t> buffer(8192 + 16);
+  for (auto &byte : buffer) {
+    byte = static_cast<uint8_t>(rng());
+  }
+
+  std::vector<size_t> lengths;
+  for (size_t len = 0; len <= 300; ++len) {
+    lengths.push_back(len);
+  }
+  std::uniform_int_distribution<size_t> randomLength(0, 8192);
+  for (int i = 0; i < 200; ++i) {
+    lengths.push_back(randomLength(rng));
+  }
+
+  for (const auto &kernel : crc32Kernels()) {
+    for (size_t len : lengths) {
+      for (size_t offset = 0; offset < 16; ++offset) {
+        std::span<const uint8_t> data(buffer.data() + offset, len);
+        uint32_t got =
+            kernel.update(0xFFFFFFFF, data.data(), data.size()) ^ 0xFFFFFFFF;
+        if (got != referenceCrc32(data)) {
+          std::cerr << kernel.name << " length " << len << " offset "
+                    << offset << '\n';
+          CHECK(got == referenceCrc32(data));
+          return;
+        }
+      }
+    }
+  }
+}
+
+// Feeding a buffer in random pieces matches one pass over all of it
+void checkStreaming(std::mt19937 &rng) {
+  std::vector<uint8_t> buffer(4096);
+  for (auto &byte : buffer) {
+    byte = static_cast<uint8_t>(rng());
+  }
+  for (int round = 0; round < 500; ++round) {
+    size_t len = rng() % buffer.size();
+    std::span<const uint8_t> data(buffer.data(), len);
+    Crc32 crc;
+    size_t pos = 0;
+    while (pos < len) {
+      size_t piece = std::min<size_t>(len - pos, rng() % 200);
+      crc.update(data.subspan(pos, piece));
+      pos += piece;
+    }
+    CHECK(crc.value() == referenceCrc32(data));
+  }
+}
+
+// A finalized datagram passes isValidMessage, flipping any bit fails it
+void checkDatagrams() {
+  ControllersInfoRequest request{};
+  request.ports = 2;
+  request.slots = {0, 3};
+  Packet packet;
+  std::memcpy(packet.header.magic, "DSUC", 4);
+  packet.header.protocol = 1001;
+  packet.header.clientServerID = 0xdeadbeef;
+  packet.type = MessageType::ControllersInfoMessage;
+  packet.body = request.serialize();
+  auto datagram = packet.serialize();
+  CHECK(isValidMessage(datagram) == DeserializeError::None);
+
+  for (size_t bit = 0; bit < datagram.size() * 8; ++bit) {
+    auto corrupted = datagram;
+    corrupted[bit / 8] ^= static_cast<uint8_t>(1 << (bit % 8));
+    CHECK(isValidMessage(corrupted) != DeserializeError::None);
+  }
+}
+
+} // namespace
+
+int main() {
+  std::mt19937 rng(2024);
+  checkKnownVector();
+  checkKernels(rng);
+  checkStreaming(rng);
+  checkDatagrams();
+  return test::result();
+}
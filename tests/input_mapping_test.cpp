@@ -0,0 +1,268 @@
+// Checks the input mapping tables against the path they replaced: the
+// button if-chain DsuServer used to run over every 24-bit button word, and
+// ProControllerHid's stick and IMU conversion followed by the old float to
+// byte step over every pair of raw stick values. Also reads calibration out
+// of a fake SPI flash, with and without user calibration.
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include "check.hpp"
+#include "input_mapping.hpp"
+#include "packet/packet.hpp"
+
+namespace {
+
+using ProControllerHid::ButtonStatus;
+using ProControllerHid::RawInputStatus;
+
+// DsuServer's mapping before the tables
+uint32_t oldButtons(const ButtonStatus &buttons) {
+  uint8_t buttons1 = 0;
+  uint8_t buttons2 = 0;
+  if (buttons.LeftButton)
+    buttons1 |= ButtonDPadLeft;
+  if (buttons.DownButton)
+    buttons1 |= ButtonDPadDown;
+  if (buttons.RightButton)
+    buttons1 |= ButtonDPadRight;
+  if (buttons.UpButton)
+    buttons1 |= ButtonDPadUp;
+  if (buttons.MinusButton)
+    buttons1 |= ButtonOptions;
+  if (buttons.RStick)
+    buttons1 |= ButtonR3;
+  if (buttons.LStick)
+    buttons1 |= ButtonL3;
+  if (buttons.ShareButton)
+    buttons1 |= ButtonShare;
+
+  if (buttons.YButton)
+    buttons2 |= ButtonY;
+  if (buttons.BButton)
+    buttons2 |= ButtonB;
+  if (buttons.AButton)
+    buttons2 |= ButtonA;
+  if (buttons.XButton)
+    buttons2 |= ButtonX;
+  if (buttons.RButton)
+    buttons2 |= ButtonR1;
+  if (buttons.LButton)
+    buttons2 |= ButtonL1;
+  if (buttons.RZButton)
+    buttons2 |= ButtonR2;
+  if (buttons.LZButton)
+    buttons2 |= ButtonL2;
+
+  uint32_t home = buttons.HomeButton;
+  return buttons1 | buttons2 << 8 | home << 16;
+}
+
+// ProControllerHid's conversion of one stick axis
+float libraryAxis(int raw, int center, int min, int max) {
+  int offset = raw - center;
+  float axis = offset >= 0 ? static_cast<float>(offset) /
+                                 static_cast<float>(max - center)
+                           : static_cast<float>(center - raw) /
+                                 static_cast<float>(min - center);
+  return axis < -1.0f ? -1.0f : axis > 1.0f ? 1.0f : axis;
+}
+
+// Stick byte as the old path computed it from the library's floats
+std::array<uint8_t, 2> oldStick(const StickCalibration &cal, int rawX,
+                                int rawY) {
+  float x = 0.0f;
+  float y = 0.0f;
+  if (std::abs(rawX - cal.centerX) > cal.deadzone ||
+      std::abs(rawY - cal.centerY) > cal.deadzone) {
+    x = libraryAxis(rawX, cal.centerX, cal.minX, cal.maxX);
+    y = libraryAxis(rawY, cal.centerY, cal.minY, cal.maxY);
+  }
+  return {static_cast<uint8_t>((x + 1.0f) * 127.5f),
+          static_cast<uint8_t>((y + 1.0f) * 127.5f)};
+}
+
+void checkButtons() {
+  uint32_t mismatches = 0;
+  for (uint32_t raw = 0; raw < (1u << 24); ++raw) {
+    ButtonStatus buttons;
+    std::memcpy(&buttons, &raw, sizeof(buttons));
+    if (mapButtons(raw) != oldButtons(buttons)) {
+      ++mismatches;
+    }
+  }
+  CHECK(mismatches == 0);
+}
+
+// Both sticks over every raw X and Y
+void checkSticks(const ControllerCalibration &cal) {
+  RawInputMapping mapping = makeRawInputMapping(cal);
+  RawInputStatus status{};
+  uint32_t mismatches = 0;
+  for (int x = 0; x < 4096; ++x) {
+    for (int y = 0; y < 4096; ++y) {
+      status.LeftStick.AxisX = x;
+      status.LeftStick.AxisY = y;
+      status.RightStick.AxisX = 4095 - x;
+      status.RightStick.AxisY = 4095 - y;
+      MappedInput input = mapInput(status, mapping);
+      auto left = oldStick(cal.leftStick, x, y);
+      auto right = oldStick(cal.rightStick, 4095 - x, 4095 - y);
+      if (input.lStickX != left[0] || input.lStickY != left[1] ||
+          input.rStickX != right[0] || input.rStickY != right[1]) {
+        ++mismatches;
+      }
+    }
+  }
+  CHECK(mismatches == 0);
+}
+
+void checkImu(const ControllerCalibration &cal) {
+  RawInputMapping mapping = makeRawInputMapping(cal);
+  RawInputStatus status{};
+  status.HasSensorStatus = true;
+  for (int raw = -32768; raw < 32768; raw += 7) {
+    auto value = static_cast<int16_t>(raw);
+    for (auto &sample : status.Sensors) {
+      sample.Accelerometer = {value, static_cast<int16_t>(-value), 4096};
+      sample.Gyroscope = {value, 0, static_cast<int16_t>(value / 3)};
+    }
+    MappedInput input = mapInput(status, mapping);
+    CHECK(input.hasSensorStatus);
+    const auto &imu = cal.imu;
+    const auto &sample = status.Sensors[2];
+    const auto &mapped = input.sensors[2];
+    CHECK(mapped.Accelerometer.Y ==
+          static_cast<float>(static_cast<double>(sample.Accelerometer.Y) *
+                             4.0 /
+                             static_cast<double>(imu[1].coeff -
+                                                 imu[1].origin)));
+    CHECK(mapped.Gyroscope.Z ==
+          static_cast<float>(
+              static_cast<double>(sample.Gyroscope.Z - imu[5].origin) *
+              0.0027777778 * 936.0 /
+              static_cast<double>(imu[5].coeff - imu[5].origin)));
+  }
+}
+
+// 12-bit X and Y packed into three bytes
+void pack12(uint8_t *out, uint16_t x, uint16_t y) {
+  out[0] = static_cast<uint8_t>(x);
+  out[1] = static_cast<uint8_t>((x >> 8) | (y << 4));
+  out[2] = static_cast<uint8_t>(y >> 4);
+}
+
+void put16(uint8_t *out, int value) {
+  out[0] = static_cast<uint8_t>(value);
+  out[1] = static_cast<uint8_t>(value >> 8);
+}
+
+// SPI flash with factory calibration only
+std::map<uint32_t, uint8_t> factoryFlash() {
+  std::vector<uint8_t> imu(24);
+  const int values[12] = {-60, 30, 120,  16384, 16384, 16384,
+                          14,  -8, -21, 13371, 13371, 13371};
+  for (size_t i = 0; i < 12; ++i) {
+    put16(&imu[i * 2], values[i]);
+  }
+  // Left: above, center, below. Right: center, below, above
+  std::vector<uint8_t> left(9);
+  pack12(&left[0], 1500, 1450);
+  pack12(&left[3], 2048, 2000);
+  pack12(&left[6], 1400, 1520);
+  std::vector<uint8_t> right(9);
+  pack12(&right[0], 2100, 1980);
+  pack12(&right[3], 1350, 1300);
+  pack12(&right[6], 1480, 1420);
+  std::vector<uint8_t> params(18);
+  params[3] = 0xAE; // Deadzone 174
+  params[4] = 0x00;
+
+  std::map<uint32_t, uint8_t> flash;
+  auto write = [&](uint32_t address, const std::vector<uint8_t> &bytes) {
+    for (size_t i = 0; i < bytes.size(); ++i) {
+      flash[address + i] = bytes[i];
+    }
+  };
+  write(0x6020, imu);
+  write(0x603D, left);
+  write(0x6046, right);
+  write(0x6086, params);
+  write(0x6098, params);
+  // Erased user area
+  write(0x8010, std::vector<uint8_t>(0x30, 0xFF));
+  return flash;
+}
+
+SpiReader reader(const std::map<uint32_t, uint8_t> &flash) {
+  return [&flash](uint32_t address, std::span<uint8_t> out) {
+    for (size_t i = 0; i < out.size(); ++i) {
+      auto it = flash.find(address + static_cast<uint32_t>(i));
+      if (it == flash.end()) {
+        return false;
+      }
+      out[i] = it->second;
+    }
+    return true;
+  };
+}
+
+ControllerCalibration checkFactoryCalibration() {
+  auto flash = factoryFlash();
+  auto cal = readCalibration(reader(flash));
+  CHECK(cal.has_value());
+  if (!cal) {
+    return {};
+  }
+  const auto &left = cal->leftStick;
+  CHECK(left.centerX == 2048 && left.centerY == 2000);
+  CHECK(left.minX == 2048 - 1400 && left.minY == 2000 - 1520);
+  CHECK(left.maxX == 2048 + 1500 && left.maxY == 2000 + 1450);
+  CHECK(left.deadzone == 174);
+  const auto &right = cal->rightStick;
+  CHECK(right.centerX == 2100 && right.centerY == 1980);
+  CHECK(right.minX == 2100 - 1350 && right.minY == 1980 - 1300);
+  CHECK(right.maxX == 2100 + 1480 && right.maxY == 1980 + 1420);
+  CHECK(cal->imu[0].origin == -60 && cal->imu[0].coeff == 16384);
+  CHECK(cal->imu[5].origin == -21 && cal->imu[5].coeff == 13371);
+  return *cal;
+}
+
+void checkUserCalibration() {
+  auto flash = factoryFlash();
+  // User left stick with the magic, centered elsewhere
+  std::array<uint8_t, 11> user = {0xB2, 0xA1};
+  pack12(&user[2], 1000, 1000);
+  pack12(&user[5], 1900, 2100);
+  pack12(&user[8], 1000, 1000);
+  for (size_t i = 0; i < user.size(); ++i) {
+    flash[0x8010 + i] = user[i];
+  }
+  auto cal = readCalibration(reader(flash));
+  CHECK(cal.has_value());
+  if (cal) {
+    CHECK(cal->leftStick.centerX == 1900 && cal->leftStick.centerY == 2100);
+    // Right stick and IMU have no user calibration
+    CHECK(cal->rightStick.centerX == 2100);
+    CHECK(cal->imu[0].origin == -60);
+  }
+
+  // A failed read leaves the caller on the library's conversion
+  flash.erase(0x6098);
+  CHECK(!readCalibration(reader(flash)).has_value());
+}
+
+} // namespace
+
+int main() {
+  checkButtons();
+  ControllerCalibration cal = checkFactoryCalibration();
+  checkUserCalibration();
+  checkSticks(cal);
+  checkImu(cal);
+  return test::result();
+}
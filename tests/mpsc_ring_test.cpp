@@ -0,0 +1,105 @@
+// Stress test for MpscRing, the queue behind AsyncLog: several producers
+// push numbered entries into a small ring while one consumer pops them.
+// Every entry has to arrive exactly once, untorn, and in push order per
+// producer, and a full ring has to refuse pushes without losing what it
+// holds.
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "check.hpp"
+#include "common/mpsc_ring.hpp"
+
+namespace {
+
+// Several words so a torn copy shows up as disagreeing words
+struct Entry {
+  uint32_t producer;
+  uint64_t sequence;
+  std::array<uint64_t, 6> words;
+};
+
+Entry make(uint32_t producer, uint64_t sequence) {
+  Entry entry{};
+  entry.producer = producer;
+  entry.sequence = sequence;
+  for (size_t i = 0; i < entry.words.size(); ++i) {
+    entry.words[i] = (sequence * 0x9E3779B97F4A7C15ull) ^ (producer + i);
+  }
+  return entry;
+}
+
+void checkFull() {
+  MpscRing<Entry, 8> ring;
+  for (uint64_t i = 0; i < 8; ++i) {
+    CHECK(ring.push(make(0, i)));
+  }
+  CHECK(!ring.push(make(0, 8)));
+  Entry entry;
+  for (uint64_t i = 0; i < 8; ++i) {
+    CHECK(ring.pop(entry));
+    CHECK(entry.sequence == i);
+  }
+  CHECK(!ring.pop(entry));
+  // Cells are reusable after a wrap
+  CHECK(ring.push(make(0, 9)));
+  CHECK(ring.pop(entry) && entry.sequence == 9);
+}
+
+} // namespace
+
+int main() {
+  checkFull();
+
+  constexpr uint64_t PerProducer = 500'000;
+  const unsigned producerCount =
+      std::max(2u, std::min(8u, std::thread::hardware_concurrency()));
+
+  // Small enough that producers keep finding it full
+  MpscRing<Entry, 64> ring;
+  std::vector<std::jthread> producers;
+  for (uint32_t p = 0; p < producerCount; ++p) {
+    producers.emplace_back([&, p] {
+      for (uint64_t i = 0; i < PerProducer;) {
+        if (ring.push(make(p, i))) {
+          ++i;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  std::vector<uint64_t> next(producerCount, 0);
+  uint64_t total = 0;
+  uint64_t torn = 0;
+  uint64_t outOfOrder = 0;
+  Entry entry;
+  while (total < PerProducer * producerCount) {
+    if (!ring.pop(entry)) {
+      std::this_thread::yield();
+      continue;
+    }
+    ++total;
+    if (entry.producer >= producerCount ||
+        entry.words != make(entry.producer, entry.sequence).words) {
+      ++torn;
+      continue;
+    }
+    if (entry.sequence != next[entry.producer]) {
+      ++outOfOrder;
+    }
+    next[entry.producer] = entry.sequence + 1;
+  }
+  producers.clear();
+
+  CHECK(torn == 0);
+  CHECK(outOfOrder == 0);
+  CHECK(std::all_of(next.begin(), next.end(),
+                    [](uint64_t n) { return n == PerProducer; }));
+  CHECK(!ring.pop(entry));
+  return test::result();
+}
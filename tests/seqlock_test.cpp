@@ -0,0 +1,85 @@
+// Stress test for Seqlock: one writer publishes snapshots whose words are
+// all derived from a single counter while readers copy them at full rate.
+// A torn copy shows up as words that disagree, a stale one as the counter
+// going backwards.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "check.hpp"
+#include "common/seqlock.hpp"
+
+namespace {
+
+// Larger than a cache line and not a multiple of the word size
+struct Snapshot {
+  uint64_t counter;
+  std::array<uint32_t, 19> words;
+  uint8_t tail;
+};
+
+Snapshot make(uint64_t counter) {
+  Snapshot snapshot{};
+  snapshot.counter = counter;
+  for (size_t i = 0; i < snapshot.words.size(); ++i) {
+    snapshot.words[i] = static_cast<uint32_t>(counter * 2654435761u + i);
+  }
+  snapshot.tail = static_cast<uint8_t>(counter);
+  return snapshot;
+}
+
+bool consistent(const Snapshot &snapshot) {
+  Snapshot expected = make(snapshot.counter);
+  return snapshot.words == expected.words && snapshot.tail == expected.tail;
+}
+
+} // namespace
+
+int main() {
+  constexpr uint64_t Writes = 2'000'000;
+  const unsigned readerCount =
+      std::max(2u, std::min(8u, std::thread::hardware_concurrency()));
+
+  Seqlock<Snapshot> lock;
+  lock.store(make(0));
+  std::atomic<bool> done{false};
+  std::atomic<uint64_t> torn{0};
+  std::atomic<uint64_t> backwards{0};
+  std::atomic<uint64_t> reads{0};
+
+  std::vector<std::jthread> readers;
+  for (unsigned r = 0; r < readerCount; ++r) {
+    readers.emplace_back([&] {
+      uint64_t last = 0;
+      uint64_t count = 0;
+      while (!done.load(std::memory_order_relaxed)) {
+        Snapshot snapshot = lock.load();
+        if (!consistent(snapshot)) {
+          torn.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (snapshot.counter < last) {
+          backwards.fetch_add(1, std::memory_order_relaxed);
+        }
+        last = snapshot.counter;
+        ++count;
+      }
+      reads.fetch_add(count, std::memory_order_relaxed);
+    });
+  }
+
+  for (uint64_t i = 1; i <= Writes; ++i) {
+    lock.store(make(i));
+  }
+  done.store(true);
+  readers.clear();
+
+  CHECK(torn.load() == 0);
+  CHECK(backwards.load() == 0);
+  CHECK(reads.load() > 0);
+  CHECK(lock.load().counter == Writes);
+  return test::result();
+}
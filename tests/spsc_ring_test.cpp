@@ -0,0 +1,82 @@
+// Stress test for SpscRing: one producer pushes a counter sequence while
+// the consumer pops it. Every value has to come out exactly once and in
+// order, and a full ring has to refuse pushes without losing what it holds.
+
+#include <array>
+#include <cstdint>
+#include <thread>
+
+#include "check.hpp"
+#include "common/spsc_ring.hpp"
+
+namespace {
+
+// Several words so a torn copy shows up as disagreeing words
+struct Entry {
+  uint64_t counter;
+  std::array<uint64_t, 5> words;
+};
+
+Entry make(uint64_t counter) {
+  Entry entry{};
+  entry.counter = counter;
+  for (size_t i = 0; i < entry.words.size(); ++i) {
+    entry.words[i] = counter * 0x9E3779B97F4A7C15ull + i;
+  }
+  return entry;
+}
+
+} // namespace
+
+int main() {
+  // Single-threaded: fill, overflow, drain
+  {
+    SpscRing<Entry, 8> ring;
+    for (uint64_t i = 0; i < 8; ++i) {
+      CHECK(ring.push(make(i)));
+    }
+    CHECK(!ring.push(make(8)));
+    Entry entry;
+    for (uint64_t i = 0; i < 8; ++i) {
+      CHECK(ring.pop(entry));
+      CHECK(entry.counter == i);
+    }
+    CHECK(!ring.pop(entry));
+  }
+
+  constexpr uint64_t Count = 2'000'000;
+  SpscRing<Entry, 64> ring;
+  std::jthread producer([&] {
+    for (uint64_t i = 0; i < Count;) {
+      if (ring.push(make(i))) {
+        ++i;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  uint64_t expected = 0;
+  uint64_t torn = 0;
+  uint64_t outOfOrder = 0;
+  Entry entry;
+  while (expected < Count) {
+    if (!ring.pop(entry)) {
+      std::this_thread::yield();
+      continue;
+    }
+    if (entry.words != make(entry.counter).words) {
+      ++torn;
+    }
+    if (entry.counter != expected) {
+      ++outOfOrder;
+    }
+    expected = entry.counter + 1;
+  }
+  producer.join();
+
+  CHECK(torn == 0);
+  CHECK(outOfOrder == 0);
+  CHECK(!ring.pop(entry));
+  return test::result();
+}
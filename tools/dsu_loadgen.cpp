@@ -0,0 +1,363 @@
+// Load generator for DsuServer: simulates N cemuhook clients, each on its own
+// socket. Pollers repeatedly request controller and motor info and measure
+// the round trip, subscribers register for controller data and track the
+// pushed packetNum sequence. Prints a JSON report when done.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <print>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "common/latency_histogram.hpp"
+#include "packet/packet.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  std::string host = "127.0.0.1";
+  uint16_t port = 26760;
+  size_t clients = 100;
+  // Fraction of clients that subscribe instead of polling
+  double subscribers = 0.5;
+  // Requests per second of every polling client
+  double rate = 100;
+  double duration = 10;
+};
+
+// Requests without a reply after this long count as lost
+constexpr auto ReplyTimeout = std::chrono::seconds(1);
+// Subscribers renew well within the server's client timeout
+constexpr auto RenewInterval = std::chrono::seconds(1);
+
+struct Outstanding {
+  MessageType type;
+  Clock::time_point sent;
+};
+
+struct SimClient {
+  int fd = -1;
+  bool subscriber = false;
+  uint32_t id = 0;
+  Clock::time_point nextSend;
+  std::deque<Outstanding> outstanding;
+
+  bool seenData = false;
+  uint32_t expectedPacketNum = 0;
+};
+
+struct Results {
+  uint64_t requestsSent = 0;
+  uint64_t repliesReceived = 0;
+  uint64_t repliesLost = 0;
+  uint64_t unexpectedReplies = 0;
+  uint64_t subscriptionsSent = 0;
+  uint64_t dataPackets = 0;
+  uint64_t packetNumGaps = 0;
+  uint64_t packetNumMissing = 0;
+  uint64_t packetNumReordered = 0;
+  uint64_t invalidPackets = 0;
+  uint64_t sendErrors = 0;
+  LatencyHistogram rtt;
+};
+
+PacketHeader clientHeader(uint32_t id) {
+  PacketHeader header{};
+  std::memcpy(header.magic, "DSUC", 4);
+  header.protocol = 1001;
+  header.clientServerID = id;
+  return header;
+}
+
+template <typename Body>
+ByteBuffer buildRequest(uint32_t id, MessageType type, const Body &body) {
+  Packet packet;
+  packet.header = clientHeader(id);
+  packet.type = type;
+  packet.body = body.serialize();
+  return packet.serialize();
+}
+
+ByteBuffer infoRequest(uint32_t id) {
+  ControllersInfoRequest cirq{};
+  cirq.ports = 4;
+  cirq.slots = {0, 1, 2, 3};
+  return buildRequest(id, MessageType::ControllersInfoMessage, cirq);
+}
+
+ByteBuffer motorsRequest(uint32_t id, uint8_t slot) {
+  ControllersMotorsRequest cmrq{};
+  cmrq.controllerId.type = ControllerIdTypeSlot;
+  cmrq.controllerId.slot = slot;
+  return buildRequest(id, MessageType::ControllersMotorsInfoMessage, cmrq);
+}
+
+ByteBuffer subscribeRequest(uint32_t id) {
+  // No identifier bits subscribes to every controller
+  ControllersDataRequest cdrq{};
+  return buildRequest(id, MessageType::ControllersDataMessage, cdrq);
+}
+
+bool sendTo(const SimClient &client, const ByteBuffer &buf,
+            const sockaddr_in &server, Results &results) {
+  if (sendto(client.fd, buf.data(), buf.size(), 0,
+             (const sockaddr *)&server, sizeof(server)) < 0) {
+    ++results.sendErrors;
+    return false;
+  }
+  return true;
+}
+
+void sendNext(SimClient &client, const sockaddr_in &server,
+              Clock::time_point now, std::mt19937 &rng, const Options &options,
+              Results &results) {
+  if (client.subscriber) {
+    if (sendTo(client, subscribeRequest(client.id), server, results)) {
+      ++results.subscriptionsSent;
+    }
+    client.nextSend = now + RenewInterval;
+    return;
+  }
+
+  // Mostly info polls with the occasional motor query, like cemuhook
+  bool motors = rng() % 5 == 0;
+  auto type = motors ? MessageType::ControllersMotorsInfoMessage
+                     : MessageType::ControllersInfoMessage;
+  auto buf = motors ? motorsRequest(client.id, rng() % 4)
+                    : infoRequest(client.id);
+  if (sendTo(client, buf, server, results)) {
+    ++results.requestsSent;
+    client.outstanding.push_back({type, now});
+  }
+
+  // Exponential gaps so pollers don't stay in lockstep
+  std::exponential_distribution<double> gap(options.rate);
+  client.nextSend =
+      now + std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(gap(rng)));
+}
+
+void receive(SimClient &client, Results &results) {
+  uint8_t buf[512];
+  while (true) {
+    ssize_t received = recv(client.fd, buf, sizeof(buf), 0);
+    if (received < 0) {
+      return;
+    }
+    auto now = Clock::now();
+
+    PacketView view;
+    if (view.deserialize(std::span(buf, static_cast<size_t>(received)),
+                         PacketOrigin::Server) != DeserializeError::None) {
+      ++results.invalidPackets;
+      continue;
+    }
+
+    if (view.type == MessageType::ControllersDataMessage) {
+      ControllersDataResponse cdrs;
+      if (cdrs.deserialize(view.body) != DeserializeError::None) {
+        ++results.invalidPackets;
+        continue;
+      }
+      ++results.dataPackets;
+      if (client.seenData) {
+        if (cdrs.packetNum > client.expectedPacketNum) {
+          ++results.packetNumGaps;
+          results.packetNumMissing +=
+              cdrs.packetNum - client.expectedPacketNum;
+        } else if (cdrs.packetNum < client.expectedPacketNum) {
+          ++results.packetNumReordered;
+          continue;
+        }
+      }
+      client.seenData = true;
+      client.expectedPacketNum = cdrs.packetNum + 1;
+      continue;
+    }
+
+    // Replies come back in request order per type, match the oldest one
+    auto it = std::find_if(
+        client.outstanding.begin(), client.outstanding.end(),
+        [&](const Outstanding &o) { return o.type == view.type; });
+    if (it == client.outstanding.end()) {
+      ++results.unexpectedReplies;
+      continue;
+    }
+    results.rtt.record(now - it->sent);
+    ++results.repliesReceived;
+    client.outstanding.erase(it);
+  }
+}
+
+void expireOutstanding(SimClient &client, Clock::time_point now,
+                       Results &results) {
+  while (!client.outstanding.empty() &&
+         now - client.outstanding.front().sent > ReplyTimeout) {
+    client.outstanding.pop_front();
+    ++results.repliesLost;
+  }
+}
+
+double micros(std::chrono::nanoseconds ns) { return ns.count() / 1000.0; }
+
+void printReport(const Options &options, size_t subscribers, double elapsed,
+                 const Results &r) {
+  double lossRatio =
+      r.requestsSent ? static_cast<double>(r.repliesLost) / r.requestsSent : 0;
+  std::println("{{");
+  std::println("  \"clients\": {},", options.clients);
+  std::println("  \"subscribers\": {},", subscribers);
+  std::println("  \"duration_s\": {:.3f},", elapsed);
+  std::println("  \"requests_sent\": {},", r.requestsSent);
+  std::println("  \"replies_received\": {},", r.repliesReceived);
+  std::println("  \"replies_lost\": {},", r.repliesLost);
+  std::println("  \"loss_ratio\": {:.6f},", lossRatio);
+  std::println("  \"unexpected_replies\": {},", r.unexpectedReplies);
+  std::println("  \"reply_throughput_per_s\": {:.1f},",
+               r.repliesReceived / elapsed);
+  std::println("  \"subscriptions_sent\": {},", r.subscriptionsSent);
+  std::println("  \"data_packets\": {},", r.dataPackets);
+  std::println("  \"data_throughput_per_s\": {:.1f},",
+               r.dataPackets / elapsed);
+  std::println("  \"packet_num_gaps\": {},", r.packetNumGaps);
+  std::println("  \"packet_num_missing\": {},", r.packetNumMissing);
+  std::println("  \"packet_num_reordered\": {},", r.packetNumReordered);
+  std::println("  \"invalid_packets\": {},", r.invalidPackets);
+  std::println("  \"send_errors\": {},", r.sendErrors);
+  std::println("  \"rtt_us\": {{\"count\": {}, \"p50\": {:.1f}, \"p99\": "
+               "{:.1f}, \"p999\": {:.1f}}}",
+               r.rtt.count(), micros(r.rtt.percentile(50)),
+               micros(r.rtt.percentile(99)), micros(r.rtt.percentile(99.9)));
+  std::println("}}");
+}
+
+bool parseOptions(int argc, char **argv, Options &options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      return false;
+    }
+    const char *value = argv[++i];
+    if (arg == "--host") {
+      options.host = value;
+    } else if (arg == "--port") {
+      options.port = static_cast<uint16_t>(std::strtoul(value, nullptr, 10));
+    } else if (arg == "--clients") {
+      options.clients = std::strtoul(value, nullptr, 10);
+    } else if (arg == "--subscribers") {
+      options.subscribers = std::clamp(std::strtod(value, nullptr), 0.0, 1.0);
+    } else if (arg == "--rate") {
+      options.rate = std::max(std::strtod(value, nullptr), 0.1);
+    } else if (arg == "--duration") {
+      options.duration = std::strtod(value, nullptr);
+    } else {
+      return false;
+    }
+  }
+  return options.clients > 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    std::cerr << "Usage: " << argv[0]
+              << " [--host ADDR] [--port N] [--clients N] [--subscribers "
+                 "FRACTION] [--rate REQ_PER_S] [--duration SECONDS]"
+              << std::endl;
+    return 1;
+  }
+
+  sockaddr_in server{};
+  server.sin_family = AF_INET;
+  server.sin_port = htons(options.port);
+  if (inet_pton(AF_INET, options.host.c_str(), &server.sin_addr) != 1) {
+    std::cerr << "Invalid host: " << options.host << std::endl;
+    return 1;
+  }
+
+  std::mt19937 rng(12345);
+  std::vector<SimClient> clients(options.clients);
+  std::vector<pollfd> fds(options.clients);
+  auto subscribers =
+      static_cast<size_t>(options.clients * options.subscribers + 0.5);
+  auto start = Clock::now();
+  for (size_t i = 0; i < clients.size(); ++i) {
+    auto &client = clients[i];
+    client.fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, IPPROTO_UDP);
+    if (client.fd < 0) {
+      std::cerr << "socket failed: " << std::strerror(errno) << std::endl;
+      return 1;
+    }
+    client.subscriber = i < subscribers;
+    client.id = rng();
+    // Spread the first requests over one polling interval
+    client.nextSend =
+        start + std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double>(
+                        std::uniform_real_distribution<double>(
+                            0, 1 / options.rate)(rng)));
+    fds[i] = {client.fd, POLLIN, 0};
+  }
+
+  Results results;
+  auto end = start + std::chrono::duration_cast<Clock::duration>(
+                         std::chrono::duration<double>(options.duration));
+  auto now = start;
+  while (now < end) {
+    // Sleep until the next scheduled request or an incoming reply
+    auto next = end;
+    for (const auto &client : clients) {
+      next = std::min(next, client.nextSend);
+    }
+    auto wait = std::chrono::ceil<std::chrono::milliseconds>(next - now);
+    poll(fds.data(), fds.size(), static_cast<int>(std::max<int64_t>(
+                                     wait.count(), 0)));
+
+    now = Clock::now();
+    for (size_t i = 0; i < clients.size(); ++i) {
+      if (fds[i].revents & POLLIN) {
+        receive(clients[i], results);
+      }
+      if (clients[i].nextSend <= now) {
+        sendNext(clients[i], server, now, rng, options, results);
+      }
+      expireOutstanding(clients[i], now, results);
+    }
+  }
+
+  // Give in-flight replies a moment, then count the rest as lost
+  auto drainEnd = Clock::now() + std::chrono::milliseconds(200);
+  while ((now = Clock::now()) < drainEnd) {
+    poll(fds.data(), fds.size(), 10);
+    for (size_t i = 0; i < clients.size(); ++i) {
+      if (fds[i].revents & POLLIN) {
+        receive(clients[i], results);
+      }
+    }
+  }
+  for (auto &client : clients) {
+    results.repliesLost += client.outstanding.size();
+    close(client.fd);
+  }
+
+  double elapsed = std::chrono::duration<double>(end - start).count();
+  printReport(options, subscribers, elapsed, results);
+  return 0;
+}
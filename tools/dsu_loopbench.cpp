@@ -0,0 +1,290 @@
+// Loopback benchmark for the UDP layer: runs a UdpServer in-process on
+// 127.0.0.1 with a handler that validates each request and answers with a
+// prebuilt ControllersInfo reply, the way DsuServer serves its cached
+// replies. Client threads keep one request in flight per socket and time
+// every round trip. Prints a JSON report with requests per second and
+// round-trip percentiles for each backend asked for, so epoll and io_uring
+// can be compared on the same machine. --sweep repeats the run for 1, 2, 4...
+// receive workers up to --workers to show how SO_REUSEPORT scales.
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <print>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "common/latency_histogram.hpp"
+#include "packet/packet.hpp"
+#include "udp_server.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  // epoll, io_uring, or all to run every backend built in
+  std::string backend = "all";
+  uint16_t port = 26790;
+  // Receive workers, the upper bound with --sweep
+  size_t workers = 1;
+  bool sweep = false;
+  // Client threads, each driving its own sockets
+  size_t threads = 4;
+  // Sockets per client thread, each with one request in flight
+  size_t sockets = 8;
+  double duration = 5;
+};
+
+// Requests without a reply after this long count as lost
+constexpr auto ReplyTimeout = std::chrono::milliseconds(100);
+
+struct Results {
+  std::atomic<uint64_t> requests{0};
+  std::atomic<uint64_t> replies{0};
+  std::atomic<uint64_t> lost{0};
+  LatencyHistogram rtt;
+};
+
+PacketHeader header(const char *magic, uint32_t id) {
+  PacketHeader header{};
+  std::memcpy(header.magic, magic, 4);
+  header.protocol = 1001;
+  header.clientServerID = id;
+  return header;
+}
+
+ByteBuffer infoRequest() {
+  ControllersInfoRequest cirq{};
+  cirq.ports = 4;
+  cirq.slots = {0, 1, 2, 3};
+  Packet packet;
+  packet.header = header("DSUC", 1);
+  packet.type = MessageType::ControllersInfoMessage;
+  packet.body = cirq.serialize();
+  return packet.serialize();
+}
+
+ByteBuffer infoReply() {
+  ControllersInfoResponse cirs;
+  for (uint8_t slot = 0; slot < 4; ++slot) {
+    ControllerInfoResponse entry{};
+    entry.info.slot = slot;
+    cirs.info.push_back(entry);
+  }
+  Packet packet;
+  packet.header = header("DSUS", 2);
+  packet.type = MessageType::ControllersInfoMessage;
+  packet.body = cirs.serialize();
+  return packet.serialize();
+}
+
+// Benchmark server: checks the request like DsuServer does and copies a
+// cached reply
+class BenchServer : public UdpServer {
+public:
+  BenchServer(uint16_t port, size_t workers)
+      : UdpServer("127.0.0.1", port, workers), reply(infoReply()) {
+    setMessageHandler([this](std::span<const uint8_t> request, Connection,
+                             std::span<uint8_t, UdpBackend::MaxReplySize> out) {
+      PacketView view;
+      if (view.deserialize(request) != DeserializeError::None) {
+        return size_t{0};
+      }
+      std::memcpy(out.data(), reply.data(), reply.size());
+      return reply.size();
+    });
+  }
+
+private:
+  ByteBuffer reply;
+};
+
+void runClient(const Options &options, Clock::time_point end,
+               Results &results) {
+  sockaddr_in server{};
+  server.sin_family = AF_INET;
+  server.sin_port = htons(options.port);
+  server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  timeval timeout{};
+  timeout.tv_usec =
+      std::chrono::duration_cast<std::chrono::microseconds>(ReplyTimeout)
+          .count();
+  std::vector<int> fds;
+  for (size_t i = 0; i < options.sockets; ++i) {
+    int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd < 0 || connect(fd, (const sockaddr *)&server, sizeof(server)) != 0) {
+      std::cerr << "socket failed: " << std::strerror(errno) << std::endl;
+      std::exit(1);
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    fds.push_back(fd);
+  }
+
+  const auto request = infoRequest();
+  std::vector<Clock::time_point> sent(fds.size());
+  uint8_t buf[2048];
+  uint64_t requests = 0, replies = 0, lost = 0;
+  while (Clock::now() < end) {
+    for (size_t i = 0; i < fds.size(); ++i) {
+      sent[i] = Clock::now();
+      if (send(fds[i], request.data(), request.size(), 0) > 0) {
+        ++requests;
+      }
+    }
+    for (size_t i = 0; i < fds.size(); ++i) {
+      if (recv(fds[i], buf, sizeof(buf), 0) > 0) {
+        results.rtt.record(Clock::now() - sent[i]);
+        ++replies;
+      } else {
+        ++lost;
+      }
+    }
+  }
+  for (int fd : fds) {
+    close(fd);
+  }
+  results.requests += requests;
+  results.replies += replies;
+  results.lost += lost;
+}
+
+double micros(std::chrono::nanoseconds ns) { return ns.count() / 1000.0; }
+
+void printReport(const Options &options, const char *backend,
+                 size_t workers, double elapsed, const Results &r) {
+  std::println("{{");
+  std::println("  \"backend\": \"{}\",", backend);
+  std::println("  \"workers\": {},", workers);
+  std::println("  \"client_threads\": {},", options.threads);
+  std::println("  \"sockets\": {},", options.threads * options.sockets);
+  std::println("  \"duration_s\": {:.3f},", elapsed);
+  std::println("  \"requests\": {},", r.requests.load());
+  std::println("  \"replies\": {},", r.replies.load());
+  std::println("  \"lost\": {},", r.lost.load());
+  std::println("  \"replies_per_s\": {:.1f},", r.replies.load() / elapsed);
+  std::println("  \"rtt_us\": {{\"count\": {}, \"p50\": {:.1f}, \"p99\": "
+               "{:.1f}, \"p999\": {:.1f}}}",
+               r.rtt.count(), micros(r.rtt.percentile(50)),
+               micros(r.rtt.percentile(99)), micros(r.rtt.percentile(99.9)));
+  std::println("}}");
+}
+
+bool parseOptions(int argc, char **argv, Options &options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--sweep") {
+      options.sweep = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      return false;
+    }
+    const char *value = argv[++i];
+    if (arg == "--backend") {
+      options.backend = value;
+    } else if (arg == "--port") {
+      options.port = static_cast<uint16_t>(std::strtoul(value, nullptr, 10));
+    } else if (arg == "--workers") {
+      options.workers = std::strtoul(value, nullptr, 10);
+    } else if (arg == "--threads") {
+      options.threads = std::strtoul(value, nullptr, 10);
+    } else if (arg == "--sockets") {
+      options.sockets = std::strtoul(value, nullptr, 10);
+    } else if (arg == "--duration") {
+      options.duration = std::strtod(value, nullptr);
+    } else {
+      return false;
+    }
+  }
+  return options.workers > 0 && options.threads > 0 && options.sockets > 0 &&
+         options.duration > 0;
+}
+
+// Runs one timed round against a fresh server, false if the backend
+// isn't available in this build or on this kernel
+bool runBenchmark(const Options &options, const std::string &backend,
+                  size_t workers) {
+  // UdpBackend::create tries io_uring first unless told not to
+  if (backend == "epoll") {
+    setenv("PROCONDSU_NO_IO_URING", "1", 1);
+  } else {
+    unsetenv("PROCONDSU_NO_IO_URING");
+  }
+  BenchServer server(options.port, workers);
+  if (backend != server.backendName()) {
+    std::cerr << backend << " backend unavailable, got "
+              << server.backendName() << std::endl;
+    return false;
+  }
+  server.start();
+
+  Results results;
+  auto start = Clock::now();
+  auto end = start + std::chrono::duration_cast<Clock::duration>(
+                         std::chrono::duration<double>(options.duration));
+  {
+    std::vector<std::jthread> clients;
+    for (size_t i = 0; i < options.threads; ++i) {
+      clients.emplace_back(runClient, std::cref(options), end,
+                           std::ref(results));
+    }
+  }
+  double elapsed =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  server.stop();
+  server.wait();
+  printReport(options, server.backendName(), server.workerCount(), elapsed,
+              results);
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    std::cerr << "Usage: " << argv[0]
+              << " [--backend epoll|io_uring|all] [--port N] [--workers N] "
+                 "[--sweep] [--threads N] [--sockets N] [--duration SECONDS]"
+              << std::endl;
+    return 1;
+  }
+
+  std::vector<std::string> backends = {options.backend};
+  if (options.backend == "all") {
+    backends = {"epoll", "io_uring"};
+  }
+  std::vector<size_t> workerCounts = {options.workers};
+  if (options.sweep) {
+    workerCounts.clear();
+    for (size_t workers = 1; workers < options.workers; workers *= 2) {
+      workerCounts.push_back(workers);
+    }
+    workerCounts.push_back(options.workers);
+  }
+
+  bool ran = false;
+  for (const auto &backend : backends) {
+    for (size_t workers : workerCounts) {
+      if (!runBenchmark(options, backend, workers)) {
+        break;
+      }
+      ran = true;
+    }
+  }
+  return ran ? 0 : 1;
+}
@@ -0,0 +1,382 @@
+// Microbenchmarks for the hot paths of DsuServer and the input mapping, run
+// in-process without sockets. Every case prints one JSON line with the time
+// per operation and the heap allocations it made, so runs can be diffed
+// between builds.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <print>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "input_mapping.hpp"
+#include "packet/packet.hpp"
+
+namespace {
+
+std::atomic<uint64_t> allocations{0};
+
+} // namespace
+
+// Counts every heap allocation of the process
+void *operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  // Substring a case name must contain to run, empty runs everything
+  std::string filter;
+  // Measuring time per case
+  double seconds = 0.5;
+};
+
+// Keeps the compiler from discarding a result
+template <typename T> void keep(T &&value) {
+  asm volatile("" : : "g"(&value) : "memory");
+}
+
+// Runs body in batches for about the requested time and reports the fastest
+// batch, which filters out preemption and frequency ramp-up
+template <typename F>
+void run(const Options &options, std::string_view name, F &&body,
+         size_t bytesPerOp = 0) {
+  if (name.find(options.filter) == std::string_view::npos) {
+    return;
+  }
+
+  // Size a batch to roughly a millisecond
+  size_t batch = 1;
+  while (true) {
+    auto start = Clock::now();
+    for (size_t i = 0; i < batch; ++i) {
+      body();
+    }
+    if (Clock::now() - start >= std::chrono::milliseconds(1) ||
+        batch >= (size_t{1} << 30)) {
+      break;
+    }
+    batch *= 2;
+  }
+
+  double best = 1e300;
+  uint64_t ops = 0;
+  uint64_t allocs = allocations.load(std::memory_order_relaxed);
+  auto end = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                std::chrono::duration<double>(options.seconds));
+  do {
+    auto start = Clock::now();
+    for (size_t i = 0; i < batch; ++i) {
+      body();
+    }
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start)
+                    .count();
+    best = std::min(best, ns / batch);
+    ops += batch;
+  } while (Clock::now() < end);
+  allocs = allocations.load(std::memory_order_relaxed) - allocs;
+
+  std::print("{{\"benchmark\": \"{}\", \"ns_per_op\": {:.2f}, "
+             "\"ops_per_s\": {:.0f}, \"allocs_per_op\": {:.2f}",
+             name, best, 1e9 / best, static_cast<double>(allocs) / ops);
+  if (bytesPerOp != 0) {
+    std::print(", \"mb_per_s\": {:.1f}", bytesPerOp * 1e3 / best);
+  }
+  std::println("}}");
+}
+
+PacketHeader serverHeader() {
+  PacketHeader header{};
+  std::memcpy(header.magic, "DSUS", 4);
+  header.protocol = 1001;
+  header.clientServerID = 0x12345678;
+  return header;
+}
+
+ControllersDataResponse sampleData() {
+  ControllersDataResponse cdrs{};
+  cdrs.info.slot = 0;
+  cdrs.info.state = ControllerState::ControllerConnected;
+  cdrs.info.model = DeviceModel::DeviceModelFullGyro;
+  cdrs.info.connection = ConnectionType::ConnectionTypeBluetooth;
+  cdrs.info.batteryState = BatteryStatus::BatteryFull;
+  cdrs.connected = true;
+  cdrs.packetNum = 42;
+  cdrs.buttons = {ButtonDPadUp | ButtonL3, ButtonA | ButtonR1};
+  cdrs.lStickX = 200;
+  cdrs.lStickY = 60;
+  cdrs.rStickX = 128;
+  cdrs.rStickY = 128;
+  cdrs.timestamp = 123456789;
+  cdrs.accel = {0.01f, -0.98f, 0.12f};
+  cdrs.gyro = {1.5f, -0.25f, 90.0f};
+  return cdrs;
+}
+
+// Controller data datagram built in a stack buffer, as pushes do now,
+// against the original Packet/ByteBuffer path
+void benchSerialize(const Options &options) {
+  const PacketHeader header = serverHeader();
+  ControllersDataResponse cdrs = sampleData();
+
+  run(options, "serialize_data_in_place", [&] {
+    std::array<uint8_t, ControllersDataPacketSize> datagram;
+    ++cdrs.packetNum;
+    cdrs.serializeTo(
+        std::span(datagram)
+            .subspan<Packet::HeaderSize, ControllersDataResponse::WireSize>());
+    Packet::finalize(datagram, header, MessageType::ControllersDataMessage);
+    keep(datagram);
+  });
+
+  run(options, "serialize_data_allocating", [&] {
+    ++cdrs.packetNum;
+    Packet packet;
+    packet.header = header;
+    packet.type = MessageType::ControllersDataMessage;
+    packet.body = cdrs.serialize();
+    keep(packet.serialize());
+  });
+}
+
+template <typename Body>
+ByteBuffer request(MessageType type, const Body &body) {
+  Packet packet;
+  packet.header = serverHeader();
+  std::memcpy(packet.header.magic, "DSUC", 4);
+  packet.type = type;
+  packet.body = body.serialize();
+  return packet.serialize();
+}
+
+// Requests as a handful of cemuhook clients send them: mostly info polls
+// and subscription renewals, some motor queries and rumble, plus junk the
+// server has to reject
+std::vector<ByteBuffer> buildCorpus() {
+  std::vector<ByteBuffer> corpus;
+
+  ControllersInfoRequest info{};
+  info.ports = 4;
+  info.slots = {0, 1, 2, 3};
+  ControllersDataRequest subscribeAll{};
+  ControllersDataRequest subscribeSlot{};
+  subscribeSlot.controllerId.type = ControllerIdTypeSlot;
+  subscribeSlot.controllerId.slot = 1;
+  ControllersMotorsRequest motors{};
+  motors.controllerId.type = ControllerIdTypeSlot;
+  ControllersMotorsRumbleRequest rumble{};
+  rumble.controllerId.type = ControllerIdTypeSlot;
+  rumble.intensity = 200;
+
+  for (int i = 0; i < 8; ++i) {
+    corpus.push_back(request(MessageType::ControllersInfoMessage, info));
+    corpus.push_back(request(MessageType::ControllersDataMessage,
+                             i % 2 ? subscribeAll : subscribeSlot));
+  }
+  corpus.push_back(request(MessageType::ControllersMotorsInfoMessage, motors));
+  corpus.push_back(
+      request(MessageType::ControllersMotorsRumbleMessage, rumble));
+  corpus.push_back(request(MessageType::ProtocolVersionMessage,
+                           ProtocolVersionRequest{}));
+
+  auto badCrc = corpus.front();
+  badCrc[12] ^= 1; // Client ID, covered by the CRC
+  corpus.push_back(badCrc);
+  auto badMagic = corpus.front();
+  badMagic[3] = 'X';
+  corpus.push_back(badMagic);
+  corpus.push_back(ByteBuffer(12, 0));
+  return corpus;
+}
+
+template <typename Body> bool parseBody(std::span<const uint8_t> body) {
+  Body parsed;
+  return parsed.deserialize(body) == DeserializeError::None;
+}
+
+bool parseBody(MessageType type, std::span<const uint8_t> body) {
+  switch (type) {
+  case MessageType::ProtocolVersionMessage:
+    return parseBody<ProtocolVersionRequest>(body);
+  case MessageType::ControllersInfoMessage:
+    return parseBody<ControllersInfoRequest>(body);
+  case MessageType::ControllersDataMessage:
+    return parseBody<ControllersDataRequest>(body);
+  case MessageType::ControllersMotorsInfoMessage:
+    return parseBody<ControllersMotorsRequest>(body);
+  case MessageType::ControllersMotorsRumbleMessage:
+    return parseBody<ControllersMotorsRumbleRequest>(body);
+  default:
+    return false;
+  }
+}
+
+// The request corpus parsed through PacketView, which validates and points
+// into the datagram, against Packet, which copies the body out first
+void benchParse(const Options &options) {
+  const auto corpus = buildCorpus();
+  size_t bytes = 0;
+  for (const auto &datagram : corpus) {
+    bytes += datagram.size();
+  }
+  size_t averageSize = bytes / corpus.size();
+
+  size_t next = 0;
+  run(
+      options, "parse_corpus_view",
+      [&] {
+        const auto &datagram = corpus[next++ % corpus.size()];
+        PacketView view;
+        bool ok = view.deserialize(datagram) == DeserializeError::None &&
+                  parseBody(view.type, view.body);
+        keep(ok);
+      },
+      averageSize);
+
+  next = 0;
+  run(
+      options, "parse_corpus_copy",
+      [&] {
+        const auto &datagram = corpus[next++ % corpus.size()];
+        Packet packet;
+        bool ok = packet.deserialize(datagram) == DeserializeError::None &&
+                  parseBody(packet.type, packet.body);
+        keep(ok);
+      },
+      averageSize);
+}
+
+// Every CRC32 kernel on a controller data datagram and on a large buffer
+void benchCrc32(const Options &options) {
+  std::vector<uint8_t> buffer(64 * 1024);
+  for (size_t i = 0; i < buffer.size(); ++i) {
+    buffer[i] = static_cast<uint8_t>(i * 131 + 7);
+  }
+
+  for (const auto &kernel : crc32Kernels()) {
+    for (size_t size : {ControllersDataPacketSize, buffer.size()}) {
+      auto name = std::string("crc32_") + kernel.name + "_" +
+                  std::to_string(size);
+      run(
+          options, name,
+          [&] { keep(kernel.update(0xFFFFFFFF, buffer.data(), size)); },
+          size);
+    }
+  }
+}
+
+// Raw HID reports with moving sticks and IMU samples
+std::vector<ProControllerHid::RawInputStatus> rawReports() {
+  std::vector<ProControllerHid::RawInputStatus> reports(256);
+  for (size_t i = 0; i < reports.size(); ++i) {
+    auto &status = reports[i];
+    uint32_t buttons = static_cast<uint32_t>(i * 0x9E3779B9u) & 0xffffff;
+    std::memcpy(&status.Buttons, &buttons, sizeof(buttons));
+    status.LeftStick.AxisX = (i * 16) % 4096;
+    status.LeftStick.AxisY = (i * 37) % 4096;
+    status.RightStick.AxisX = 2048 + (i % 64);
+    status.RightStick.AxisY = 2048 - (i % 64);
+    status.HasSensorStatus = true;
+    for (auto &sample : status.Sensors) {
+      auto value = static_cast<int16_t>(i * 97);
+      sample.Accelerometer = {value, static_cast<int16_t>(-value), 4096};
+      sample.Gyroscope = {static_cast<int16_t>(value / 4), 12, -30};
+    }
+  }
+  return reports;
+}
+
+// A report through the stick LUTs against the library's float conversion
+// followed by the float mapping, which is what the LUTs replace
+void benchMapping(const Options &options) {
+  ControllerCalibration cal{};
+  cal.leftStick = {2048, 2000, 648, 480, 3548, 3450, 174};
+  cal.rightStick = {2100, 1980, 750, 680, 3580, 3400, 174};
+  for (size_t axis = 0; axis < 3; ++axis) {
+    cal.imu[axis] = {static_cast<int16_t>(axis * 40), 16384};
+    cal.imu[3 + axis] = {static_cast<int16_t>(axis * 7), 13371};
+  }
+  const RawInputMapping mapping = makeRawInputMapping(cal);
+  const auto reports = rawReports();
+
+  size_t next = 0;
+  run(options, "map_report_lut", [&] {
+    keep(mapInput(reports[next++ % reports.size()], mapping));
+  });
+
+  next = 0;
+  run(options, "map_report_float", [&] {
+    const auto &raw = reports[next++ % reports.size()];
+    ProControllerHid::InputStatus status{};
+    status.Timestamp = raw.Timestamp;
+    status.Buttons = raw.Buttons;
+    status.LeftStick =
+        stickAxes(cal.leftStick, raw.LeftStick.AxisX, raw.LeftStick.AxisY);
+    status.RightStick = stickAxes(cal.rightStick, raw.RightStick.AxisX,
+                                  raw.RightStick.AxisY);
+    status.HasSensorStatus = raw.HasSensorStatus;
+    for (size_t i = 0; i < std::size(raw.Sensors); ++i) {
+      status.Sensors[i] = imuSample(cal.imu, raw.Sensors[i]);
+    }
+    keep(mapInput(status));
+  });
+}
+
+constexpr void (*Benchmarks[])(const Options &) = {
+    benchSerialize,
+    benchParse,
+    benchCrc32,
+    benchMapping,
+};
+
+bool parseOptions(int argc, char **argv, Options &options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      return false;
+    }
+    const char *value = argv[++i];
+    if (arg == "--filter") {
+      options.filter = value;
+    } else if (arg == "--time") {
+      options.seconds = std::atof(value);
+    } else {
+      return false;
+    }
+  }
+  return options.seconds > 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    std::cerr << "Usage: " << argv[0]
+              << " [--filter SUBSTRING] [--time SECONDS]" << std::endl;
+    return 1;
+  }
+
+  for (auto benchmark : Benchmarks) {
+    benchmark(options);
+  }
+  return 0;
+}
@@ -0,0 +1,214 @@
+// Polls a running DsuServer for its counters (ServerStatsMessage) and prints
+// them. With --interval it keeps polling and turns the cumulative counters
+// into rates between consecutive snapshots. The server only answers when
+// started with --stats, and from other hosts than its own only with
+// --stats-allow for the polling address.
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <print>
+#include <string>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "packet/packet.hpp"
+
+namespace {
+
+struct Options {
+  std::string host = "127.0.0.1";
+  uint16_t port = 26760;
+  // Seconds between polls, 0 polls once
+  double interval = 0;
+  // Polls before exiting with --interval, 0 runs until killed
+  size_t count = 0;
+};
+
+constexpr auto ReplyTimeout = std::chrono::seconds(1);
+
+ByteBuffer statsRequest(uint32_t id) {
+  Packet packet;
+  packet.header = {};
+  std::memcpy(packet.header.magic, "DSUC", 4);
+  packet.header.protocol = 1001;
+  packet.header.clientServerID = id;
+  packet.type = MessageType::ServerStatsMessage;
+  packet.body = ServerStatsRequest{}.serialize();
+  return packet.serialize();
+}
+
+std::optional<ServerStatsResponse>
+queryStats(int fd, const sockaddr_in &server, uint32_t id) {
+  auto request = statsRequest(id);
+  if (sendto(fd, request.data(), request.size(), 0,
+             (const sockaddr *)&server, sizeof(server)) < 0) {
+    std::cerr << "sendto failed: " << std::strerror(errno) << std::endl;
+    return std::nullopt;
+  }
+
+  auto deadline = std::chrono::steady_clock::now() + ReplyTimeout;
+  uint8_t buf[2048];
+  while (true) {
+    auto left = std::chrono::ceil<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    pollfd pfd{fd, POLLIN, 0};
+    if (left.count() <= 0 ||
+        poll(&pfd, 1, static_cast<int>(left.count())) <= 0) {
+      std::cerr << "No reply from server" << std::endl;
+      return std::nullopt;
+    }
+
+    ssize_t received = recv(fd, buf, sizeof(buf), 0);
+    if (received < 0) {
+      continue;
+    }
+    // Skip anything that isn't our reply, e.g. a late one from a previous
+    // poll that timed out
+    PacketView view;
+    if (view.deserialize(std::span(buf, static_cast<size_t>(received)),
+                         PacketOrigin::Server) != DeserializeError::None ||
+        view.type != MessageType::ServerStatsMessage) {
+      continue;
+    }
+    ServerStatsResponse stats;
+    if (stats.deserialize(view.body) != DeserializeError::None) {
+      std::cerr << "Malformed stats reply" << std::endl;
+      return std::nullopt;
+    }
+    return stats;
+  }
+}
+
+double perSecond(uint64_t now, uint64_t before, double seconds) {
+  return seconds > 0 ? static_cast<double>(now - before) / seconds : 0;
+}
+
+void printStats(const ServerStatsResponse &stats,
+                const ServerStatsResponse *previous) {
+  // Rates since the previous poll, or averages since startup for the first
+  double seconds = previous
+                       ? (stats.uptimeMs - previous->uptimeMs) / 1000.0
+                       : stats.uptimeMs / 1000.0;
+  std::println("Uptime {:.1f} s, {} client(s)", stats.uptimeMs / 1000.0,
+               stats.clientCount);
+  std::println("Sent {} datagrams ({:.1f}/s) in {} syscalls",
+               stats.datagramsSent,
+               perSecond(stats.datagramsSent,
+                         previous ? previous->datagramsSent : 0, seconds),
+               stats.sendSyscalls);
+  std::println("Rejected: {} length, {} magic, {} checksum, {} parse, {} "
+               "type, {} table full, {} stats not allowed",
+               stats.rejectedLength, stats.rejectedMagic,
+               stats.rejectedChecksum, stats.rejectedParse,
+               stats.rejectedType, stats.rejectedTableFull,
+               stats.rejectedStats);
+  std::println("Dropped: {} log records, {} latency samples",
+               stats.logDropped, stats.traceDropped);
+
+  for (size_t i = 0; i < stats.controllers.size(); ++i) {
+    const auto &controller = stats.controllers[i];
+    if (!controller.connected && controller.reports == 0) {
+      continue;
+    }
+    uint64_t before = previous ? previous->controllers[i].reports : 0;
+    std::println("Slot {}: {}, {} reports ({:.1f}/s), latency p50 {} us, "
+                 "p99 {} us, p99.9 {} us",
+                 i, controller.connected ? "connected" : "disconnected",
+                 controller.reports,
+                 perSecond(controller.reports, before, seconds),
+                 controller.latencyP50Us, controller.latencyP99Us,
+                 controller.latencyP999Us);
+  }
+
+  for (const auto &client : stats.clients) {
+    char address[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, client.address, address, sizeof(address));
+    std::println("Client {}:{}: {} packets", address, client.port,
+                 client.packetsSent);
+  }
+  if (stats.clients.size() < stats.clientCount) {
+    std::println("... {} more client(s)",
+                 stats.clientCount - stats.clients.size());
+  }
+}
+
+bool parseOptions(int argc, char **argv, Options &options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      return false;
+    }
+    const char *value = argv[++i];
+    if (arg == "--host") {
+      options.host = value;
+    } else if (arg == "--port") {
+      options.port = static_cast<uint16_t>(std::strtoul(value, nullptr, 10));
+    } else if (arg == "--interval") {
+      options.interval = std::strtod(value, nullptr);
+    } else if (arg == "--count") {
+      options.count = std::strtoul(value, nullptr, 10);
+    } else {
+      return false;
+    }
+  }
+  return options.interval >= 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    std::cerr << "Usage: " << argv[0]
+              << " [--host ADDR] [--port N] [--interval SECONDS] [--count N]"
+              << std::endl;
+    return 1;
+  }
+
+  sockaddr_in server{};
+  server.sin_family = AF_INET;
+  server.sin_port = htons(options.port);
+  if (inet_pton(AF_INET, options.host.c_str(), &server.sin_addr) != 1) {
+    std::cerr << "Invalid host: " << options.host << std::endl;
+    return 1;
+  }
+
+  int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (fd < 0) {
+    std::cerr << "socket failed: " << std::strerror(errno) << std::endl;
+    return 1;
+  }
+
+  auto id = static_cast<uint32_t>(std::rand());
+  std::optional<ServerStatsResponse> previous;
+  for (size_t polls = 0;; ++polls) {
+    auto stats = queryStats(fd, server, id);
+    if (!stats) {
+      close(fd);
+      return 1;
+    }
+    printStats(*stats, previous ? &*previous : nullptr);
+    previous = std::move(stats);
+
+    if (options.interval == 0 ||
+        (options.count > 0 && polls + 1 >= options.count)) {
+      break;
+    }
+    std::println("");
+    std::this_thread::sleep_for(
+        std::chrono::duration<double>(options.interval));
+  }
+
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <vector>
+
+#include "common/types.hpp"
+
+struct OutgoingDatagram {
+  std::span<const uint8_t> data;
+  Connection conn;
+};
+
+// Datagrams collected during one dispatch cycle and handed to the backend in
+// a single flush. Storage is reused between cycles, so steady-state queueing
+// doesn't allocate. Not thread-safe, every sending thread owns its batch
+class SendBatch {
+public:
+  void add(std::span<const uint8_t> buf, Connection conn) {
+    size_t offset = bytes.size();
+    bytes.resize(offset + buf.size());
+    std::memcpy(bytes.data() + offset, buf.data(), buf.size());
+    entries.push_back({offset, buf.size(), conn});
+  }
+
+  // Views into the batch storage, valid until the next add() or clear()
+  std::span<const OutgoingDatagram> datagrams() {
+    views.clear();
+    for (const auto &entry : entries) {
+      views.push_back(
+          {std::span(bytes.data() + entry.offset, entry.size), entry.conn});
+    }
+    return views;
+  }
+
+  size_t size() const { return entries.size(); }
+  bool empty() const { return entries.empty(); }
+
+  void clear() {
+    bytes.clear();
+    entries.clear();
+    views.clear();
+  }
+
+private:
+  struct Entry {
+    size_t offset;
+    size_t size;
+    Connection conn;
+  };
+  ByteBuffer bytes;
+  std::vector<Entry> entries;
+  std::vector<OutgoingDatagram> views;
+};
+
+// Counters for everything a backend sends
+struct SendStats {
+  std::atomic<uint64_t> datagrams{0};
+  std::atomic<uint64_t> syscalls{0};
+  std::atomic<uint64_t> flushes{0};
+  // flushSizes[i] counts flushes of [2^i, 2^(i+1)) datagrams, the last bucket
+  // takes everything larger
+  std::array<std::atomic<uint64_t>, 8> flushSizes{};
+
+  void record(size_t datagramCount, size_t syscallCount) {
+    if (datagramCount == 0) {
+      return;
+    }
+    datagrams.fetch_add(datagramCount, std::memory_order_relaxed);
+    syscalls.fetch_add(syscallCount, std::memory_order_relaxed);
+    flushes.fetch_add(1, std::memory_order_relaxed);
+    size_t bucket = std::bit_width(datagramCount) - 1;
+    if (bucket >= flushSizes.size()) {
+      bucket = flushSizes.size() - 1;
+    }
+    flushSizes[bucket].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Adds another backend's counters, used to total up worker sockets
+  void merge(const SendStats &other) {
+    datagrams.fetch_add(other.datagrams, std::memory_order_relaxed);
+    syscalls.fetch_add(other.syscalls, std::memory_order_relaxed);
+    flushes.fetch_add(other.flushes, std::memory_order_relaxed);
+    for (size_t i = 0; i < flushSizes.size(); ++i) {
+      flushSizes[i].fetch_add(other.flushSizes[i], std::memory_order_relaxed);
+    }
+  }
+};
+
+// Socket layer behind UdpServer. Each platform provides an implementation,
+// UdpBackend::create() picks the best one available at runtime
+class UdpBackend {
+public:
+  // Room every reply gets, the handler writes a complete datagram into it
+  static constexpr size_t MaxReplySize = 1024;
+
+  // Handles one received datagram, writing the reply (if any) into reply.
+  // Returns the reply length, 0 sends nothing
+  using MsgHandler = std::function<size_t(
+      std::span<const uint8_t> request, Connection conn,
+      std::span<uint8_t, MaxReplySize> reply)>;
+
+  virtual ~UdpBackend() = default;
+
+  // Creates the socket and binds it, throws std::runtime_error on failure.
+  // reusePort lets several backends share the port (SO_REUSEPORT), the
+  // kernel then spreads clients across them
+  virtual void bind(const std::string &address, uint16_t port,
+                    bool reusePort) = 0;
+
+  // Receives datagrams until stop is requested and sends back whatever the
+  // handler writes
+  virtual void run(std::stop_token stoken, const MsgHandler &handler) = 0;
+
+  virtual void send(std::span<const uint8_t> buf, const Connection &conn) = 0;
+
+  // Sends every datagram with as few syscalls as the platform allows
+  virtual void sendBatch(std::span<const OutgoingDatagram> datagrams) = 0;
+
+  const SendStats &stats() const { return sendStats; }
+
+  // Short name of the implementation, for logs and benchmarks
+  virtual const char *name() const = 0;
+
+  // Returns a backend already bound to address:port. On Linux io_uring is
+  // tried first when built in, falling back to epoll if the kernel refuses
+  // it or PROCONDSU_NO_IO_URING is set in the environment
+  static std::unique_ptr<UdpBackend>
+  create(const std::string &address, uint16_t port, bool reusePort = false);
+
+protected:
+  SendStats sendStats;
+};
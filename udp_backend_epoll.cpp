@@ -0,0 +1,257 @@
+#include "udp_backend.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <print>
+#include <stdexcept>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+std::runtime_error systemError(const std::string &what) {
+  return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+// Linux backend: waits on epoll and drains the socket with recvmmsg, so a
+// burst of requests costs one receive and one send syscall per batch
+class EpollUdpBackend : public UdpBackend {
+public:
+  static constexpr size_t BatchSize = 32;
+  static constexpr size_t MaxDatagramSize = 512;
+
+  EpollUdpBackend() {
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+      throw systemError("epoll_create1 failed");
+    }
+    // Lets stop() interrupt epoll_wait without a timeout
+    wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakefd < 0) {
+      auto error = systemError("eventfd failed");
+      close(epfd);
+      throw error;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = wakefd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, wakefd, &ev) != 0) {
+      // The destructor won't run for a constructor that threw
+      auto error = systemError("epoll_ctl failed");
+      close(wakefd);
+      close(epfd);
+      throw error;
+    }
+  }
+
+  ~EpollUdpBackend() override {
+    for (int fd : {s, wakefd, epfd}) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+  }
+
+  const char *name() const override { return "epoll"; }
+
+  void bind(const std::string &address, uint16_t port,
+            bool reusePort) override {
+    s = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_UDP);
+    if (s < 0) {
+      throw systemError("Could not create socket");
+    }
+
+    struct sockaddr_in server {};
+    server.sin_family = AF_INET;
+    if (inet_pton(AF_INET, address.c_str(), &server.sin_addr) != 1) {
+      throw std::runtime_error("Invalid bind address: " + address);
+    }
+    server.sin_port = htons(port);
+
+    int enable = 1;
+    if (reusePort &&
+        setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0) {
+      throw systemError("setsockopt SO_REUSEPORT failed");
+    }
+
+    if (::bind(s, (struct sockaddr *)&server, sizeof(server)) != 0) {
+      throw systemError("Bind failed");
+    }
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = s;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, s, &ev) != 0) {
+      throw systemError("epoll_ctl failed");
+    }
+    std::println("Bind done on {}:{}", address, port);
+  }
+
+  void run(std::stop_token stoken, const MsgHandler &handler) override {
+    std::stop_callback wake(stoken, [this] {
+      uint64_t one = 1;
+      [[maybe_unused]] auto n = write(wakefd, &one, sizeof(one));
+    });
+
+    while (!stoken.stop_requested()) {
+      std::array<epoll_event, 2> events;
+      int n = epoll_wait(epfd, events.data(), events.size(), -1);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        std::println("epoll_wait failed: {}", std::strerror(errno));
+        break;
+      }
+
+      for (int i = 0; i < n; ++i) {
+        if (events[i].data.fd == s && !drain(handler)) {
+          return;
+        }
+      }
+    }
+  }
+
+  void send(std::span<const uint8_t> buf, const Connection &conn) override {
+    if (buf.size() > 0) {
+      sendto(s, buf.data(), buf.size(), 0, (const struct sockaddr *)&conn.addr,
+             sizeof(conn.addr));
+      sendStats.record(1, 1);
+    }
+  }
+
+  // Coalesces datagrams for any number of clients into sendmmsg calls of up
+  // to BatchSize messages, retrying partial sends. A datagram that fails
+  // outright is dropped like a lost packet
+  void sendBatch(std::span<const OutgoingDatagram> datagrams) override {
+    std::array<iovec, BatchSize> iovs;
+    std::array<mmsghdr, BatchSize> msgs;
+    size_t syscalls = 0;
+
+    for (size_t base = 0; base < datagrams.size(); base += BatchSize) {
+      size_t count = std::min(BatchSize, datagrams.size() - base);
+      for (size_t i = 0; i < count; ++i) {
+        const auto &datagram = datagrams[base + i];
+        iovs[i] = {const_cast<uint8_t *>(datagram.data.data()),
+                   datagram.data.size()};
+        msgs[i] = {};
+        msgs[i].msg_hdr.msg_name = const_cast<sockaddr_in *>(&datagram.conn.addr);
+        msgs[i].msg_hdr.msg_namelen = sizeof(datagram.conn.addr);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+      }
+
+      size_t sent = 0;
+      while (sent < count) {
+        int n = sendmmsg(s, msgs.data() + sent, count - sent, 0);
+        ++syscalls;
+        if (n < 0) {
+          if (errno != EINTR) {
+            ++sent;
+          }
+          continue;
+        }
+        sent += n;
+      }
+    }
+
+    sendStats.record(datagrams.size(), syscalls);
+  }
+
+private:
+  // Receives and answers everything queued on the socket, returns false on a
+  // fatal socket error
+  bool drain(const MsgHandler &handler) {
+    while (true) {
+      for (size_t i = 0; i < BatchSize; ++i) {
+        recvIovs[i] = {recvBuffers[i].data(), MaxDatagramSize};
+        recvMsgs[i] = {};
+        recvMsgs[i].msg_hdr.msg_name = &recvAddrs[i];
+        recvMsgs[i].msg_hdr.msg_namelen = sizeof(recvAddrs[i]);
+        recvMsgs[i].msg_hdr.msg_iov = &recvIovs[i];
+        recvMsgs[i].msg_hdr.msg_iovlen = 1;
+      }
+
+      int received = recvmmsg(s, recvMsgs.data(), BatchSize, MSG_DONTWAIT,
+                              nullptr);
+      if (received < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          return true;
+        }
+        if (errno == EINTR) {
+          continue;
+        }
+        std::println("recvmmsg failed: {}", std::strerror(errno));
+        return false;
+      }
+
+      size_t replyCount = 0;
+      for (int i = 0; i < received; ++i) {
+        auto buf = std::span<const uint8_t>(recvBuffers[i].data(),
+                                            recvMsgs[i].msg_len);
+        Connection conn(recvAddrs[i]);
+        auto &reply = replies[replyCount];
+        size_t length = handler(buf, conn, reply);
+        if (length == 0) {
+          continue;
+        }
+        outgoing[replyCount] = {std::span(reply.data(), length), conn};
+        ++replyCount;
+      }
+
+      // Replies for the whole batch go out together
+      sendBatch(std::span(outgoing.data(), replyCount));
+
+      if (static_cast<size_t>(received) < BatchSize) {
+        return true;
+      }
+    }
+  }
+
+  int s = -1;
+  int epfd = -1;
+  int wakefd = -1;
+
+  std::array<std::array<uint8_t, MaxDatagramSize>, BatchSize> recvBuffers;
+  std::array<struct sockaddr_in, BatchSize> recvAddrs;
+  std::array<iovec, BatchSize> recvIovs;
+  std::array<mmsghdr, BatchSize> recvMsgs;
+
+  std::array<std::array<uint8_t, MaxReplySize>, BatchSize> replies;
+  std::array<OutgoingDatagram, BatchSize> outgoing;
+};
+
+} // namespace
+
+#ifdef PROCONDSU_HAS_IO_URING
+// Defined in udp_backend_uring.cpp
+std::unique_ptr<UdpBackend> createIoUringUdpBackend();
+#endif
+
+std::unique_ptr<UdpBackend> UdpBackend::create(const std::string &address,
+                                               uint16_t port, bool reusePort) {
+#ifdef PROCONDSU_HAS_IO_URING
+  if (!std::getenv("PROCONDSU_NO_IO_URING")) {
+    try {
+      auto backend = createIoUringUdpBackend();
+      backend->bind(address, port, reusePort);
+      return backend;
+    } catch (const std::exception &e) {
+      std::println("io_uring unavailable ({}), using epoll", e.what());
+    }
+  }
+#endif
+
+  auto backend = std::make_unique<EpollUdpBackend>();
+  backend->bind(address, port, reusePort);
+  return backend;
+}
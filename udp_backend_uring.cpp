@@ -0,0 +1,329 @@
+#include "udp_backend.hpp"
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <print>
+#include <stdexcept>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <liburing.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+std::runtime_error uringError(const std::string &what, int err) {
+  return std::runtime_error(what + ": " + std::strerror(err));
+}
+
+// Linux io_uring backend. A multishot recvmsg stays armed against a
+// registered buffer ring and replies are submitted through the same ring, so
+// with SQPOLL available the steady state needs no syscalls at all
+class IoUringUdpBackend : public UdpBackend {
+public:
+  static constexpr unsigned RingEntries = 256;
+  static constexpr unsigned RecvBufferCount = 64; // Power of two
+  static constexpr size_t MaxDatagramSize = 512;
+  static constexpr size_t RecvBufferSize =
+      sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_in) + MaxDatagramSize;
+  static constexpr size_t SendSlotCount = 128;
+  static constexpr int BufferGroup = 0;
+
+  // user_data tags, send completions carry SendTag + slot index
+  static constexpr uint64_t RecvTag = 0;
+  static constexpr uint64_t WakeTag = 1;
+  static constexpr uint64_t SendTag = 2;
+
+  IoUringUdpBackend() {
+    // Prefer a kernel submission thread, fall back to plain submission when
+    // SQPOLL isn't permitted
+    io_uring_params params{};
+    params.flags = IORING_SETUP_SQPOLL;
+    params.sq_thread_idle = 2000;
+    int ret = io_uring_queue_init_params(RingEntries, &ring, &params);
+    if (ret < 0) {
+      params = {};
+      ret = io_uring_queue_init_params(RingEntries, &ring, &params);
+    }
+    if (ret < 0) {
+      throw uringError("io_uring_queue_init failed", -ret);
+    }
+    sqpoll = (params.flags & IORING_SETUP_SQPOLL) != 0;
+
+    bufferRing = io_uring_setup_buf_ring(&ring, RecvBufferCount, BufferGroup,
+                                         0, &ret);
+    if (!bufferRing) {
+      io_uring_queue_exit(&ring);
+      throw uringError("io_uring_setup_buf_ring failed", -ret);
+    }
+    recvBuffers.resize(RecvBufferCount * RecvBufferSize);
+    for (unsigned i = 0; i < RecvBufferCount; ++i) {
+      io_uring_buf_ring_add(bufferRing, recvBuffer(i), RecvBufferSize, i,
+                            io_uring_buf_ring_mask(RecvBufferCount), i);
+    }
+    io_uring_buf_ring_advance(bufferRing, RecvBufferCount);
+
+    freeSendSlots.reserve(SendSlotCount);
+    for (size_t i = 0; i < SendSlotCount; ++i) {
+      freeSendSlots.push_back(SendSlotCount - 1 - i);
+    }
+  }
+
+  ~IoUringUdpBackend() override {
+    io_uring_free_buf_ring(&ring, bufferRing, RecvBufferCount, BufferGroup);
+    io_uring_queue_exit(&ring);
+    if (s >= 0) {
+      close(s);
+    }
+  }
+
+  const char *name() const override { return "io_uring"; }
+
+  void bind(const std::string &address, uint16_t port,
+            bool reusePort) override {
+    s = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_UDP);
+    if (s < 0) {
+      throw uringError("Could not create socket", errno);
+    }
+
+    struct sockaddr_in server {};
+    server.sin_family = AF_INET;
+    if (inet_pton(AF_INET, address.c_str(), &server.sin_addr) != 1) {
+      throw std::runtime_error("Invalid bind address: " + address);
+    }
+    server.sin_port = htons(port);
+
+    int enable = 1;
+    if (reusePort &&
+        setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0) {
+      throw uringError("setsockopt SO_REUSEPORT failed", errno);
+    }
+
+    if (::bind(s, (struct sockaddr *)&server, sizeof(server)) != 0) {
+      throw uringError("Bind failed", errno);
+    }
+
+    // Kernels without multishot recvmsg reject the request right away,
+    // catch that here so UdpBackend::create can fall back to epoll
+    std::lock_guard<std::mutex> lock(ringMutex);
+    armReceive();
+    io_uring_submit(&ring);
+    io_uring_cqe *cqe;
+    __kernel_timespec probeTimeout{.tv_sec = 0, .tv_nsec = 20'000'000};
+    if (io_uring_wait_cqe_timeout(&ring, &cqe, &probeTimeout) == 0 &&
+        io_uring_cqe_get_data64(cqe) == RecvTag && cqe->res < 0 &&
+        cqe->res != -ENOBUFS) {
+      int err = -cqe->res;
+      io_uring_cqe_seen(&ring, cqe);
+      throw uringError("Multishot recvmsg unsupported", err);
+    }
+
+    std::println("Bind done on {}:{} (io_uring{})", address, port,
+                 sqpoll ? ", SQPOLL" : "");
+  }
+
+  void run(std::stop_token stoken, const MsgHandler &handler) override {
+    std::stop_callback wake(stoken, [this] {
+      std::lock_guard<std::mutex> lock(ringMutex);
+      if (auto *sqe = io_uring_get_sqe(&ring)) {
+        io_uring_prep_nop(sqe);
+        io_uring_sqe_set_data64(sqe, WakeTag);
+        io_uring_submit(&ring);
+      }
+    });
+
+    while (!stoken.stop_requested()) {
+      io_uring_cqe *cqe;
+      int ret = io_uring_wait_cqe(&ring, &cqe);
+      if (ret == -EINTR) {
+        continue;
+      }
+      if (ret < 0) {
+        std::println("io_uring_wait_cqe failed: {}", std::strerror(-ret));
+        break;
+      }
+
+      // Handle everything that completed, then submit the replies together
+      unsigned head;
+      unsigned seen = 0;
+      io_uring_for_each_cqe(&ring, head, cqe) {
+        handleCompletion(cqe, handler);
+        ++seen;
+      }
+      io_uring_cq_advance(&ring, seen);
+
+      std::lock_guard<std::mutex> lock(ringMutex);
+      if (pendingSends > 0 || needsSubmit) {
+        submitLocked();
+      }
+    }
+  }
+
+  void send(std::span<const uint8_t> buf, const Connection &conn) override {
+    if (buf.empty()) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(ringMutex);
+    queueSendLocked(buf, conn);
+    submitLocked();
+  }
+
+  void sendBatch(std::span<const OutgoingDatagram> datagrams) override {
+    if (datagrams.empty()) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(ringMutex);
+    for (const auto &datagram : datagrams) {
+      queueSendLocked(datagram.data, datagram.conn);
+    }
+    submitLocked();
+  }
+
+private:
+  struct SendSlot {
+    std::array<uint8_t, MaxDatagramSize> data;
+    sockaddr_in addr;
+    iovec iov;
+    msghdr msg;
+  };
+
+  uint8_t *recvBuffer(unsigned bid) {
+    return recvBuffers.data() + bid * RecvBufferSize;
+  }
+
+  // Caller holds ringMutex (or is still single-threaded in bind)
+  void armReceive() {
+    recvMsg = {};
+    recvMsg.msg_namelen = sizeof(sockaddr_in);
+    io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+    io_uring_prep_recvmsg_multishot(sqe, s, &recvMsg, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BufferGroup;
+    io_uring_sqe_set_data64(sqe, RecvTag);
+  }
+
+  void handleCompletion(io_uring_cqe *cqe, const MsgHandler &handler) {
+    uint64_t tag = io_uring_cqe_get_data64(cqe);
+    if (tag == WakeTag) {
+      return;
+    }
+    if (tag >= SendTag) {
+      std::lock_guard<std::mutex> lock(ringMutex);
+      freeSendSlots.push_back(tag - SendTag);
+      return;
+    }
+
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+      unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+      if (cqe->res > 0) {
+        handleDatagram(recvBuffer(bid), cqe->res, handler);
+      }
+      io_uring_buf_ring_add(bufferRing, recvBuffer(bid), RecvBufferSize, bid,
+                            io_uring_buf_ring_mask(RecvBufferCount), 0);
+      io_uring_buf_ring_advance(bufferRing, 1);
+    }
+
+    // The multishot request ends on errors such as running out of buffers,
+    // re-arm it
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+      if (cqe->res < 0 && cqe->res != -ENOBUFS) {
+        std::println("io_uring recvmsg failed: {}", std::strerror(-cqe->res));
+      }
+      std::lock_guard<std::mutex> lock(ringMutex);
+      armReceive();
+      needsSubmit = true;
+    }
+  }
+
+  void handleDatagram(uint8_t *buf, int len, const MsgHandler &handler) {
+    auto *out = io_uring_recvmsg_validate(buf, len, &recvMsg);
+    if (!out || (out->flags & MSG_TRUNC) ||
+        out->namelen < sizeof(sockaddr_in)) {
+      return;
+    }
+
+    sockaddr_in addr;
+    std::memcpy(&addr, io_uring_recvmsg_name(out), sizeof(addr));
+    auto *payload =
+        static_cast<const uint8_t *>(io_uring_recvmsg_payload(out, &recvMsg));
+    auto payloadLength =
+        io_uring_recvmsg_payload_length(out, len, &recvMsg);
+
+    Connection conn(addr);
+    size_t length =
+        handler(std::span(payload, payloadLength), conn, replyBuffer);
+    if (length > 0) {
+      std::lock_guard<std::mutex> lock(ringMutex);
+      queueSendLocked(std::span(replyBuffer.data(), length), conn);
+    }
+  }
+
+  // Copies the datagram into a send slot and queues a sendmsg for it. Falls
+  // back to a direct sendto when every slot is in flight or the SQ is full
+  void queueSendLocked(std::span<const uint8_t> buf, const Connection &conn) {
+    io_uring_sqe *sqe = nullptr;
+    if (!freeSendSlots.empty() && buf.size() <= MaxDatagramSize) {
+      sqe = io_uring_get_sqe(&ring);
+    }
+    if (!sqe) {
+      sendto(s, buf.data(), buf.size(), 0, (const sockaddr *)&conn.addr,
+             sizeof(conn.addr));
+      sendStats.record(1, 1);
+      return;
+    }
+
+    size_t index = freeSendSlots.back();
+    freeSendSlots.pop_back();
+    auto &slot = sendSlots[index];
+    std::memcpy(slot.data.data(), buf.data(), buf.size());
+    slot.addr = conn.addr;
+    slot.iov = {slot.data.data(), buf.size()};
+    slot.msg = {};
+    slot.msg.msg_name = &slot.addr;
+    slot.msg.msg_namelen = sizeof(slot.addr);
+    slot.msg.msg_iov = &slot.iov;
+    slot.msg.msg_iovlen = 1;
+
+    io_uring_prep_sendmsg(sqe, s, &slot.msg, 0);
+    io_uring_sqe_set_data64(sqe, SendTag + index);
+    ++pendingSends;
+  }
+
+  // With SQPOLL io_uring_submit only enters the kernel to wake an idle
+  // submission thread, so those submits are counted as free
+  void submitLocked() {
+    size_t queued = pendingSends;
+    pendingSends = 0;
+    needsSubmit = false;
+    io_uring_submit(&ring);
+    sendStats.record(queued, sqpoll ? 0 : 1);
+  }
+
+  io_uring ring;
+  bool sqpoll = false;
+  int s = -1;
+
+  io_uring_buf_ring *bufferRing = nullptr;
+  std::vector<uint8_t> recvBuffers;
+  msghdr recvMsg{};
+  // Receive thread only
+  std::array<uint8_t, MaxReplySize> replyBuffer;
+
+  // Guards SQ access and send slot bookkeeping, sends are submitted from
+  // the receive thread and from UdpServer::flush callers
+  std::mutex ringMutex;
+  std::array<SendSlot, SendSlotCount> sendSlots;
+  std::vector<size_t> freeSendSlots;
+  size_t pendingSends = 0;
+  bool needsSubmit = false;
+};
+
+} // namespace
+
+std::unique_ptr<UdpBackend> createIoUringUdpBackend() {
+  return std::make_unique<IoUringUdpBackend>();
+}
@@ -0,0 +1,133 @@
+#include "udp_backend.hpp"
+
+#include <iostream>
+#include <stdexcept>
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+namespace {
+
+class WinsockUdpBackend : public UdpBackend {
+public:
+  WinsockUdpBackend() {
+    std::cout << "Initialising Winsock..." << std::endl;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+      throw std::runtime_error("WSAStartup failed: " +
+                               std::to_string(WSAGetLastError()));
+    }
+    std::cout << "Initialised." << std::endl;
+  }
+
+  ~WinsockUdpBackend() override {
+    if (s != INVALID_SOCKET) {
+      closesocket(s);
+    }
+    WSACleanup();
+  }
+
+  // Winsock has no SO_REUSEPORT equivalent, UdpServer always runs a single
+  // worker here
+  const char *name() const override { return "winsock"; }
+
+  void bind(const std::string &address, uint16_t port, bool) override {
+    if ((s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == INVALID_SOCKET) {
+      throw std::runtime_error("Could not create socket: " +
+                               std::to_string(WSAGetLastError()));
+    }
+    std::cout << "Socket created." << std::endl;
+
+    u_long mode = 1; // 1 for non-blocking, 0 for blocking
+    if (ioctlsocket(s, FIONBIO, &mode) != 0) {
+      throw std::runtime_error("ioctlsocket failed: " +
+                               std::to_string(WSAGetLastError()));
+    }
+
+    struct sockaddr_in server {};
+    server.sin_family = AF_INET;
+    inet_pton(AF_INET, address.c_str(), &server.sin_addr);
+    server.sin_port = htons(port);
+
+    if (::bind(s, (struct sockaddr *)&server, sizeof(server)) ==
+        SOCKET_ERROR) {
+      throw std::runtime_error("Bind failed with error code : " +
+                               std::to_string(WSAGetLastError()));
+    }
+    std::cout << "Bind done on port " << port << std::endl;
+  }
+
+  void run(std::stop_token stoken, const MsgHandler &handler) override {
+    struct sockaddr_in si_other;
+    int slen = sizeof(si_other);
+    char recv_buf[512];
+
+    while (!stoken.stop_requested()) {
+      fd_set readfds;
+      FD_ZERO(&readfds);
+      FD_SET(s, &readfds);
+
+      timeval tv;
+      tv.tv_sec = 1; // 1 second timeout
+      tv.tv_usec = 0;
+
+      int select_result = select(0, &readfds, nullptr, nullptr, &tv);
+      if (select_result == SOCKET_ERROR) {
+        std::cerr << "select failed with error code : " << WSAGetLastError()
+                  << std::endl;
+        break;
+      }
+
+      if (select_result == 0) { // timeout
+        continue;
+      }
+
+      // Data is available
+      int recv_len =
+          recvfrom(s, recv_buf, 512, 0, (struct sockaddr *)&si_other, &slen);
+      if (recv_len == SOCKET_ERROR) {
+        std::cerr << "recvfrom failed with error code : " << WSAGetLastError()
+                  << std::endl;
+        break;
+      }
+
+      Connection conn(si_other);
+      auto buf = std::span<const uint8_t>(
+          reinterpret_cast<const uint8_t *>(recv_buf), recv_len);
+
+      size_t length = handler(buf, conn, reply);
+      send(std::span(reply.data(), length), conn);
+    }
+  }
+
+  void send(std::span<const uint8_t> buf, const Connection &conn) override {
+    if (buf.size() > 0) {
+      sendto(s, (const char *)buf.data(), static_cast<int>(buf.size()), 0,
+             (struct sockaddr *)&conn.addr, sizeof(conn.addr));
+      sendStats.record(1, 1);
+    }
+  }
+
+  // Winsock has no multi-destination send, one sendto per datagram
+  void sendBatch(std::span<const OutgoingDatagram> datagrams) override {
+    for (const auto &datagram : datagrams) {
+      sendto(s, (const char *)datagram.data.data(),
+             static_cast<int>(datagram.data.size()), 0,
+             (struct sockaddr *)&datagram.conn.addr,
+             sizeof(datagram.conn.addr));
+    }
+    sendStats.record(datagrams.size(), datagrams.size());
+  }
+
+private:
+  WSADATA wsa;
+  SOCKET s = INVALID_SOCKET;
+  std::array<uint8_t, MaxReplySize> reply;
+};
+
+} // namespace
+
+std::unique_ptr<UdpBackend> UdpBackend::create(const std::string &address,
+                                               uint16_t port, bool reusePort) {
+  auto backend = std::make_unique<WinsockUdpBackend>();
+  backend->bind(address, port, reusePort);
+  return backend;
+}
@@ -2,39 +2,59 @@
 
 #include <cstdint>
 #include <functional>
+#include <memory>
+#include <span>
 #include <stop_token>
 #include <string>
 #include <thread>
-#include <winsock2.h>
+#include <vector>
 
 #include "common/types.hpp"
+#include "udp_backend.hpp"
 
 class UdpServer {
-  using MsgHandler = std::function<ByteBuffer(const ByteBuffer &, Connection)>;
+  using MsgHandler = UdpBackend::MsgHandler;
 
 public:
-  UdpServer(const std::string &address = "127.0.0.1", uint16_t port = 26760);
+  // With more than one worker every worker binds its own SO_REUSEPORT socket
+  // and runs its own receive loop. Windows always uses a single worker
+  UdpServer(const std::string &address = "127.0.0.1", uint16_t port = 26760,
+            size_t workers = 1);
   ~UdpServer();
 
   void start();
   void wait();
   void stop();
 
+  size_t workerCount() const { return backends.size(); }
+  const char *backendName() const { return backends.front()->name(); }
+
   void setMessageHandler(MsgHandler _handler);
-  static ByteBuffer defaultMessageHandler(const ByteBuffer &buf,
-                                          Connection conn);
+  static size_t
+  defaultMessageHandler(std::span<const uint8_t> buf, Connection conn,
+                        std::span<uint8_t, UdpBackend::MaxReplySize> reply);
 
 private:
-  void listen(std::stop_token token);
+  void listen(std::stop_token token, size_t worker);
 
 protected:
-  void send(const ByteBuffer &buf, Connection conn);
+  // Called from a worker (inside the message handler) this replies through
+  // that worker's socket, from any other thread it uses the first worker's
+  void send(std::span<const uint8_t> buf, Connection conn);
+  // Sends everything queued in the batch and empties it
+  void flush(SendBatch &batch);
+
+  // Adds up the send counters of every worker
+  void collectSendStats(SendStats &total) const;
 
 private:
-  std::jthread listenThread;
+  UdpBackend &currentBackend() const;
+
+  std::vector<std::jthread> listenThreads;
   MsgHandler msgHandler;
 
-  WSADATA wsa;
-  SOCKET s;
-  struct sockaddr_in server;
-};
\ No newline at end of file
+  std::vector<std::unique_ptr<UdpBackend>> backends;
+
+  // Backend of the worker running on this thread, null outside workers
+  static thread_local UdpBackend *workerBackend;
+};